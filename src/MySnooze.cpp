@@ -36,18 +36,43 @@
 #include <util/atomic.h>
 #include <avr/wdt.h>
 
+#if defined(MY_SNOOZE_STANDALONE)
+#include <Arduino.h>
+#include <avr/sleep.h>
+#else
 #include "MyConfig.h"
 #include "core/MySensorsCore.h"
 #include "core/MyTransport.h"
 #include "core/MyIndication.h"
 #include "hal/architecture/MyHwHAL.h"
 #include "hal/architecture/AVR/MyHwAVR.h"
+#endif
 
 #include "MySnooze.h"
 
+#if defined(MY_SNOOZE_STANDALONE)
+#define hwMillis()	millis()
+#if !defined(MY_SERIALDEVICE)
+#define MY_DISABLED_SERIAL
+#endif
+#if defined(MY_SNOOZE_RADIO_POLICY) || defined(MY_SNOOZE_RADIO_METER)
+#error "MY_SNOOZE_RADIO_POLICY and MY_SNOOZE_RADIO_METER need MySensors transport"
+#endif
+#endif
+
+// ATtiny25/45/85 and others call the watchdog control register WDTCR
+#if !defined(WDTCSR) && defined(WDTCR)
+#define WDTCSR	WDTCR
+#endif
+// ATtiny13, ATtiny2313 and others call the watchdog interrupt enable bit WDTIE
+#if !defined(WDIE) && defined(WDTIE)
+#define WDIE	WDTIE
+#endif
+
 
 #define WDTO_SLEEP_FOREVER		(0xFFu)
 #define INVALID_INTERRUPT_NUM	(0xFFu)
+#define TICK_MS					(8000)		// max sleep time credited between calls to tick()
 
 // debug output
 #if defined(MY_DEBUG_VERBOSE_CORE)
@@ -56,9 +81,143 @@
 #define CORE_DEBUG(x,...)									//!< debug NULL
 #endif
 
+//----- radio power state selection
+
+#if defined(MY_SNOOZE_RADIO_POLICY)
+
+enum { RADIO_STANDBY, RADIO_SLEEP, RADIO_POWERDOWN, RADIO_N_STATES };
+
+#if defined(MY_SNOOZE_RADIO_METER)
+static void _radioMeterOff();
+#endif
+
+/// cost of a radio state: current while in that state, and charge needed to get back to standby
+typedef struct {
+	uint32_t	nA;			//!< current in nA while in this state
+	uint32_t	wake_nAms;	//!< charge in nA*ms to wake up from this state (radio and MCU)
+} radioCost_t;
+
+#if !defined(MY_SNOOZE_RADIO_COST)
+// nominal values estimated from datasheets, define MY_SNOOZE_RADIO_COST to use measured values
+ #if defined(MY_RADIO_RF24) || defined(MY_RADIO_NRF24)
+  #if defined(MY_RF24_POWER_PIN)
+   #define MY_SNOOZE_RADIO_COST	{ { 26000, 0 }, { 900, 6000000 }, { 0, 400000000 } }
+  #else
+   #define MY_SNOOZE_RADIO_COST	{ { 26000, 0 }, { 900, 6000000 }, { 900, 6000000 } }
+  #endif
+ #elif defined(MY_RADIO_RFM69)
+  #if defined(MY_RFM69_POWER_PIN)
+   #define MY_SNOOZE_RADIO_COST	{ { 1250000, 0 }, { 100, 3000000 }, { 0, 50000000 } }
+  #else
+   #define MY_SNOOZE_RADIO_COST	{ { 1250000, 0 }, { 100, 3000000 }, { 100, 3000000 } }
+  #endif
+ #else
+  #error "MY_SNOOZE_RADIO_POLICY: no cost table for this transport, define MY_SNOOZE_RADIO_COST"
+ #endif
+#endif
+
+static const radioCost_t radioCost[RADIO_N_STATES] PROGMEM = MY_SNOOZE_RADIO_COST;
+
+
+/**
+ * @brief select the radio state that needs the least charge for sleeping `ms` and waking up again
+ * @param ms   planned sleep duration, or 0 if waiting for interrupt only
+ * @return RADIO_STANDBY, RADIO_SLEEP or RADIO_POWERDOWN
+ */
+static
+uint8_t _radioStateFor(uint32_t ms)
+{
+	if (!ms) ms = UINT32_MAX;
+	uint8_t best = RADIO_STANDBY;
+	for (uint8_t s=RADIO_SLEEP; s<RADIO_N_STATES; s++) {
+		const uint32_t nA = pgm_read_dword(&radioCost[s].nA);
+		const uint32_t bestnA = pgm_read_dword(&radioCost[best].nA);
+		if (nA >= bestnA) continue;
+		const uint32_t wake = pgm_read_dword(&radioCost[s].wake_nAms);
+		const uint32_t bestwake = pgm_read_dword(&radioCost[best].wake_nAms);
+		// deeper state pays off if sleep is longer than break-even time
+		if (wake <= bestwake || ms >= (wake - bestwake) / (bestnA - nA))
+			best = s;
+	}
+	return best;
+}
+
+
+/**
+ * @brief put radio into the cheapest state for planned sleep duration
+ * @return state selected, to be passed to _radioLeave()
+ */
+static
+uint8_t _radioEnter(uint32_t ms)
+{
+	const uint8_t state = _radioStateFor(ms);
+	CORE_DEBUG(PSTR("MCO:SLP:RST=%d\n"), state);
+	switch (state) {
+		case RADIO_STANDBY:
+			transportHALStandBy();
+			break;
+		case RADIO_POWERDOWN:
+			transportDisable();
+			transportHALPowerDown();
+#if defined(MY_SNOOZE_RADIO_METER)
+			_radioMeterOff();
+#endif
+			break;
+		default:
+			transportDisable();
+#if defined(MY_SNOOZE_RADIO_METER)
+			_radioMeterOff();
+#endif
+			break;
+	}
+	return state;
+}
+
+
+/**
+ * @brief after sleep, bring radio back from power down if necessary
+ */
+static
+void _radioLeave(uint8_t state)
+{
+	if (state == RADIO_POWERDOWN) {
+		transportReInitialise();
+#if defined(MY_SNOOZE_RADIO_METER)
+		snoozeRadioActivity();
+#endif
+	}
+}
+
+#endif // MY_SNOOZE_RADIO_POLICY
+
 //----- external references 
 
+#if defined(ATTINY_CORE)
+extern volatile unsigned long millis_timer_millis;	// defined in ATTinyCore wiring.c
+#define timer0_millis	millis_timer_millis
+#else
 extern volatile unsigned long timer0_millis;	// defined in Arduino core wiring.c
+#endif
+
+// Weak references, so that only UARTs used elsewhere get linked in and flushed.
+// The Arduino core is linked as a library, SerialN objects are only linked if referenced.
+#if defined(HAVE_HWSERIAL0)
+#pragma weak Serial
+#endif
+#if defined(HAVE_HWSERIAL1)
+#pragma weak Serial1
+#endif
+#if defined(HAVE_HWSERIAL2)
+#pragma weak Serial2
+#endif
+#if defined(HAVE_HWSERIAL3)
+#pragma weak Serial3
+#endif
+
+#if defined(MY_SNOOZE_STANDALONE)
+// MySensors defines the watchdog ISR, without MySensors we need our own
+EMPTY_INTERRUPT(WDT_vect);
+#endif
 
 //----- public variables ----------------------------------------------------
 
@@ -67,6 +226,58 @@ volatile uint8_t wokeUpWhy = 0;
 //----- local functions -----------------------------------------------------
 
 static uint8_t ADENsave;
+static wakeFilter_t wakeFilter = NULL;
+// with MY_SNOOZE_MINIMAL, nothing writes to these, and the code using them is optimized away
+static timeListener_t timeListeners[MY_SNOOZE_MAX_TIME_LISTENERS];
+static snoozeTask_t* taskList;	// resumable tasks that run between naps
+static uint16_t coalesceMS;		// window for merging bursts of interrupts, 0 if disabled
+#if !defined(MY_SNOOZE_MINIMAL)
+static snoozeConversion_t* conversionList;	// sensor conversions for snoozeConvertAll()
+#endif
+static uint32_t sleptMS;		// time credited to millis() during current sleep
+static uint8_t burstCount;		// number of interrupts merged into last wakeup
+static uint32_t sinceTick;		// time credited since tick() was called, across all steps of a sleep
+#if defined(MY_SNOOZE_TRACE)
+static uint16_t wakeNapMS;		// nominal length of the nap an interrupt ended sleep in, not credited
+#endif
+
+#if defined(MY_SNOOZE_HISTOGRAMS)
+static void _histAdd(uint8_t which, uint32_t value);
+#endif
+
+/// nap durations in ms, indexed by WDTO_xx constant
+static const uint16_t napTable[] PROGMEM = { 15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000 };
+
+
+/**
+ * @brief number of 15..120ms naps needed to sleep `ms`, short by less than 15ms
+ */
+static
+uint8_t _shortNaps(uint16_t ms)
+{
+	const uint8_t n = ms / 15;
+	return (n >> 3) + (n & 1) + ((n >> 1) & 1) + ((n >> 2) & 1);
+}
+
+
+/**
+ * @brief find the first nap of the fewest naps that sleep `ms`, short by less than 15ms.
+ * This is the longest nap that is not longer than `ms`, except for 250..499ms, where 
+ * 120ms naps may do with fewer naps, e.g. 360ms = 3*120ms, not 250+60+30+15ms.
+ * @return WDTO_xx constant, or WDTO_SLEEP_FOREVER if `ms` is shorter than the shortest nap
+ */
+static
+uint8_t _napFor(uint32_t ms)
+{
+	uint8_t wdto = WDTO_8S;
+	do {
+		if (ms >= pgm_read_word(&napTable[wdto])) break;
+	} while (wdto--);
+	if (wdto == WDTO_250MS && _shortNaps(ms) < 1 + _shortNaps(ms - 250))
+		wdto = WDTO_120MS;
+	return wdto;
+}
+
 
 /** 
  * @brief call this function once before calling _doPowerDown multiple times 
@@ -110,7 +321,8 @@ void _doPowerDown(const uint8_t wdto)
 	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
 	cli();
 	sleep_enable();
-#if defined __AVR_ATmega328P__
+#if defined(BODS) && defined(BODSE)
+	// ATmega328P, ATmega1284P, ATtiny85 etc can disable BOD during sleep, ATmega2560 can't
 	sleep_bod_disable();
 #endif
 	sei();
@@ -127,140 +339,631 @@ void _doPowerDown(const uint8_t wdto)
 
 
 /**
- * @brief   Sleep once using watchdog timer.
- * 
- * @param wdto  sleep duration (SLEEP_8S, SLEEP_4S etc) or WDTO_SLEEP_FOREVER
- * @param ms    sleep duration in milliseconds, used to adjust millis() counter
- * @return      0 if timer expired or !=0 if interrupt 
+ * @brief Let serial prints finish (debug, log etc), on all hardware UARTs used by the application
  */
 static
-int8_t myPowerDown(const uint8_t wdto, unsigned long ms)
+void _flushSerial()
+{
+#ifndef MY_DISABLED_SERIAL
+	MY_SERIALDEVICE.flush();
+#endif
+#if defined(HAVE_HWSERIAL0)
+	if (&Serial) Serial.flush();
+#endif
+#if defined(HAVE_HWSERIAL1)
+	if (&Serial1) Serial1.flush();
+#endif
+#if defined(HAVE_HWSERIAL2)
+	if (&Serial2) Serial2.flush();
+#endif
+#if defined(HAVE_HWSERIAL3)
+	if (&Serial3) Serial3.flush();
+#endif
+}
+
+
+/**
+ * @brief   pass interrupt wakeup through wake filter, if installed
+ * @param why   value of `wokeUpWhy`
+ * @return      value to return from sleep, or 0 if wakeup was rejected
+ */
+static
+int8_t _acceptWake(int8_t why)
+{
+	if (!wakeFilter || (why = wakeFilter(why)))
+		return why;
+	wokeUpWhy = 0;
+	return 0;
+}
+
+
+/**
+ * @brief   advance millis() counter by time slept
+ */
+static
+void _credit(uint16_t ms)
 {
-	_doPowerDown(wdto);
-	if (wokeUpWhy)
-		return wokeUpWhy;
 	ATOMIC_BLOCK(ATOMIC_FORCEON)
 	{
 		// adjust variable used by Arduino millis() library function
 		timer0_millis += ms;
 	}
+	sleptMS += ms;
+}
+
+
+/**
+ * @brief   Sleep once using watchdog timer, or until interrupt.
+ * 
+ * @param wdto  sleep duration (WDTO_8S, WDTO_4S etc) or WDTO_SLEEP_FOREVER
+ * @return      0 if timer expired, nap has been credited to millis() counter,
+ *              or value of `wokeUpWhy` if interrupt, nothing credited
+ */
+static
+int8_t myPowerDown(const uint8_t wdto)
+{
+	_doPowerDown(wdto);
+	const int8_t why = wokeUpWhy;
+	if (!why && wdto != WDTO_SLEEP_FOREVER)
+		_credit(pgm_read_word(&napTable[wdto]));
+	return why;
+}
+
+
+/**
+ * @brief run all tasks that are due, remove finished tasks from list
+ * @return 0, or value returned by a task that wants to end sleep
+ */
+static
+int8_t _runTasks()
+{
+	snoozeTask_t** pp = &taskList;
+	while (*pp) {
+		snoozeTask_t* t = *pp;
+		if ((int32_t)(millis() - t->due) >= 0) {
+			int8_t why = t->func(t);
+			if (t->lc == TASK_DONE) {
+				*pp = t->next;
+				t->func = NULL;
+			} else {
+				pp = &t->next;
+			}
+			if (why) return why;
+		} else {
+			pp = &t->next;
+		}
+	}
 	return 0;
 }
 
 
+/**
+ * @brief time until next task is due
+ * @return milliseconds, 0 if a task is already due
+ */
+static
+uint32_t _taskWait()
+{
+	uint32_t wait = UINT32_MAX;
+	const uint32_t now = millis();
+	for (snoozeTask_t* t = taskList; t; t = t->next) {
+		int32_t dt = (int32_t)(t->due - now);
+		if (dt <= 0) return 0;
+		if ((uint32_t)dt < wait) wait = dt;
+	}
+	return wait;
+}
+
+
+/**
+ * @brief call tick() if defined by application
+ * @return value returned by tick(), or 0
+ */
+static
+int8_t _callTick()
+{
+	if (!tick) return 0;
+	sei();		// sleep may end before the first nap has enabled interrupts
+#if defined(MY_SNOOZE_HISTOGRAMS)
+	const uint32_t start = micros();
+	const int8_t why = tick();
+	_histAdd(SNOOZE_HIST_TICK, micros() - start);
+	return why;
+#else
+	return tick();
+#endif
+}
+
+
 /**
  * @brief Sleep for an extended period of time, may be longer than max watchdog period.
- * One sleep may consist of multiple naps (calls to `myPowerDown()`), in 8s increments, until 
+ * One sleep may consist of multiple naps (calls to `myPowerDown()`), up to 8s each, until 
  * desired sleep time is expired or other break condition has occured.
- * After each nap, calls function `tick()` if it is defined, and ends sleep immediately if
- * `tick()` returns !=0
+ * Naps are shortened so that resumable tasks run when they are due.
+ * Calls function `tick()` if it is defined, after at most 8s of sleep, and ends sleep immediately if
+ * `tick()` returns !=0. Naps are shortened so that half-credited naps don't delay it.
+ * If a coalescing window is set, the first interrupt doesn't end sleep, but starts the window,
+ * and naps continue until the window is over.
  * 
- * @param ms    Desired sleep duration in milliseconds
+ * @param ms    Desired sleep duration in milliseconds, or 0 to sleep until interrupt
+ * @param last  if true, call `tick()` when time is over, because the whole sleep ends
  * @return      0 if timer expired or !=0 if interrupt 
  */
 static
-int8_t myInternalSleep(unsigned long ms)
+int8_t myInternalSleep(uint32_t ms, const bool last)
 {
-  int8_t why;
-	// Let serial prints finish (debug, log etc)
-#ifndef MY_DISABLED_SERIAL
-	MY_SERIALDEVICE.flush();
+	int8_t why;
+	int8_t burst = 0;			// interrupts merged in coalescing window, 0 if no window open
+	uint16_t windowMS = 0;		// time left in coalescing window
+	const bool forever = (ms == 0);
+	_flushSerial();
+
+	for (;;) {
+		const uint32_t before = sleptMS;
+		if (taskList) {
+			// tasks run with interrupts enabled, like tick(), and with ADC as it was before sleep
+			ADCSRA |= ADENsave;
+			sei();
+			why = _runTasks();
+			_flushSerial();
+			cli();
+			ADCSRA &= ~(1 << ADEN);
+			if (why) return why;
+		}
+		if (!forever && _napFor(ms) == WDTO_SLEEP_FOREVER) break;
+
+		uint8_t wdto = WDTO_SLEEP_FOREVER;		// sleep until ext interrupt triggered
+		if (!forever || taskList || burst) {
+			uint32_t limit = forever ? UINT32_MAX : ms;
+			if (burst && windowMS < limit) limit = windowMS;
+			if (taskList) {
+				const uint32_t wait = _taskWait();
+				if (wait < limit) limit = wait;
+			}
+			if (tick && TICK_MS - sinceTick < limit) limit = TICK_MS - sinceTick;
+			wdto = _napFor(limit);
+			if (wdto == WDTO_SLEEP_FOREVER) wdto = WDTO_15MS;	// a task is due very soon
+		}
+
+		uint16_t nap = 0;
+		int8_t raw = wokeUpWhy;			// set while tasks or tick() were running, no nap needed
+		if (!raw) {
+			if (wdto != WDTO_SLEEP_FOREVER) nap = pgm_read_word(&napTable[wdto]);
+			raw = myPowerDown(wdto);
+			if (!raw && wdto == WDTO_SLEEP_FOREVER) return 0;
+		}
+		if (raw) {
+			why = _acceptWake(raw);
+			// spurious wakeup, or more of a burst: we can't tell how much of the nap has passed, assume half
+			if (!why || burst) _credit(nap / 2);
+			if (why) {
+				if (burst) {
+					// codes made by the wake filter (e.g. keys) and values with sign bit set aren't
+					// merged, they end the window early and are returned instead
+					if (why != raw || why < 0) return why;
+					burst |= why;
+					if (burstCount < UINT8_MAX) burstCount++;
+				} else if (coalesceMS >= 15 && why == raw && why > 0) {
+					burst = why;
+					burstCount = 1;
+					windowMS = coalesceMS;
+				} else {
+#if defined(MY_SNOOZE_TRACE)
+					if (!wakeNapMS) wakeNapMS = nap;
+#endif
+					return why;
+				}
+				wokeUpWhy = 0;
+			}
+		}
+
+		// includes naps taken by tasks and wake filter, e.g. for debouncing
+		sinceTick += sleptMS - before;
+		if (sinceTick > TICK_MS - 15) {		// no nap fits before tick() is due
+			sinceTick = 0;
+			if ((why = _callTick())) return why;
+		}
+		// ... and by tick(), so snoozeNap() there doesn't make sleep longer
+		const uint32_t credited = sleptMS - before;
+		if (!forever) ms -= (credited < ms) ? credited : ms;
+		if (burst) {
+			windowMS -= (credited < windowMS) ? credited : windowMS;
+			if (windowMS < 15) return burst;
+		}
+	}
+	if (burst) return burst;
+	return last ? _callTick() : 0;
+}
+
+
+//----- supply voltage gating
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega32U4__)
+#define VCC_ADMUX	(_BV(REFS0) | 0x1E)		// AVcc reference, measure 1.1V bandgap
+#define VCC_MUX5							// ... with MUX5 in ADCSRB cleared
+#elif defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega1284__) || defined(__AVR_ATmega644P__)
+#define VCC_ADMUX	(_BV(REFS0) | 0x1E)		// AVcc reference, measure 1.1V bandgap
+#elif defined(__AVR_ATtiny25__) || defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
+#define VCC_ADMUX	(0x0C)					// Vcc reference, measure 1.1V bandgap
+#elif defined(__AVR_ATtiny24__) || defined(__AVR_ATtiny44__) || defined(__AVR_ATtiny84__)
+#define VCC_ADMUX	(0x21)					// Vcc reference, measure 1.1V bandgap
+#else
+#define VCC_ADMUX	(_BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1))	// ATmega328P etc
+#endif
+
+static uint16_t vccOnMV;		// 0 if gating disabled
+static uint16_t vccOffMV;
+static bool vccHigh = true;		// assume enough energy after reset
+
+
+/**
+ * @brief Measure supply voltage via internal bandgap reference, works while ADC is disabled for sleep.
+ * @return supply voltage in mV
+ */
+uint16_t snoozeReadVcc()
+{
+	const uint8_t ADMUXsave = ADMUX;
+	const uint8_t ADCSRAsave = ADCSRA;
+#if defined(VCC_MUX5)
+	const uint8_t ADCSRBsave = ADCSRB;
+	ADCSRB &= ~_BV(MUX5);
+#endif
+	ADMUX = VCC_ADMUX;
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	delayMicroseconds(1000);		// let bandgap reference settle
+	uint16_t adc = 0;
+	for (uint8_t i=0; i<2; i++) {	// first conversion after switching is inaccurate
+		ADCSRA |= _BV(ADSC);
+		while (ADCSRA & _BV(ADSC)) {}
+		adc = ADC;
+	}
+	ADCSRA = ADCSRAsave;
+	ADMUX = ADMUXsave;
+#if defined(VCC_MUX5)
+	ADCSRB = ADCSRBsave;
 #endif
+	return adc ? (uint16_t)(MY_SNOOZE_BANDGAP_MV * 1024UL / adc) : UINT16_MAX;
+}
 
-  while (ms >= 8000) {
-    if ((why=myPowerDown(WDTO_8S,8000))) return why;
-		if (tick && (why = tick())) return why;
-    ms -= 8000;
-  }
-  if (ms >= 4000) {
-    if ((why=myPowerDown(WDTO_4S,4000))) return why;
-		ms -= 4000;
-  }
-  if (ms >= 2000) {
-    if ((why=myPowerDown(WDTO_2S,2000))) return why;
-		ms -= 2000;
-  }
-  if (ms >= 1000) {
-    if ((why=myPowerDown(WDTO_1S,1000))) return why;
-		ms -= 1000;
-  }
-  if (ms >= 500) {
-    if ((why=myPowerDown(WDTO_500MS,500))) return why;
-		ms -= 500;
-  }
-  if (ms >= 250) {
-    if ((why=myPowerDown(WDTO_250MS,250))) return why;
-		ms -= 250;
-  }
-  if (ms >= 120) {
-    if ((why=myPowerDown(WDTO_120MS,120))) return why;
-		ms -= 120;
-  }
-  if (ms >= 60) {
-    if ((why=myPowerDown(WDTO_60MS,60))) return why;
-		ms -= 60;
-  }
-  if (ms >= 30) {
-    if ((why=myPowerDown(WDTO_30MS,30))) return why;
-		ms -= 30;
-  }
-  if (ms >= 15) {
-    if ((why=myPowerDown(WDTO_15MS,15))) return why;
-		ms -= 15;
-  }
-  return tick ? tick() : 0;
+
+/**
+ * @brief check if enough energy is stored to wake up, with hysteresis
+ */
+static
+bool _vccOK()
+{
+	const uint16_t mV = snoozeReadVcc();
+	if (vccHigh && mV < vccOffMV) vccHigh = false;
+	else if (!vccHigh && mV >= vccOnMV) vccHigh = true;
+	CORE_DEBUG(PSTR("MCO:SLP:VCC=%u,OK=%d\n"), mV, vccHigh);
+	return vccHigh;
 }
 
+#endif // MY_SNOOZE_MINIMAL
+
 
 /** 
   * @brief Sleep, wake up after `ms` ms, or after user interrupt set flag, or after call to tick() returned !=0 .
+  * @param last  see myInternalSleep()
   */
 static
-int8_t mySleep( uint32_t ms )
+int8_t mySleep( uint32_t ms, const bool last )
 {
   	int8_t why;
 	// Disable interrupts until going to sleep, otherwise interrupts occurring between here
 	// and sleep might cause the ATMega to not wakeup from sleep as interrupt has already be handled!
+	// `wokeUpWhy` is cleared when sleep starts, in _snoozeEnter(), not here: an interrupt 
+	// between two steps of snoozeStep() must end sleep in the next step
 	cli();
-  	wokeUpWhy = 0;
+	sleptMS = 0;
+	burstCount = 0;
   	_pre_doPowerDown();
 
-	if (ms>0) {
-		// sleep for defined time
-		why = myInternalSleep(ms);
-	} else {
-		// sleep until ext interrupt triggered
-		_doPowerDown(WDTO_SLEEP_FOREVER);
-    	why = wokeUpWhy;
-	}
+	// sleep for defined time, or until ext interrupt triggered if ms==0
+	why = myInternalSleep(ms, last);
   	// Clear woke-up-by-interrupt flag, so next sleeps won't return immediately.
-	wokeUpWhy = 0;
+	if (why) wokeUpWhy = 0;
 
   	_post_doPowerDown();
+	// sleep may have ended before any nap, with interrupts still disabled
+	sei();
 
   	return why ? why : MY_WAKE_UP_BY_TIMER;
 }
 
-//----- public functions
 
 /**
- * @brief  Sleep for a defined time or forever, wake up when interrupt or when tick() returned !=0.
- * Uses watchdog timer to sleep, periodically calls `tick()` function if defined
+ * @brief tell all registered listeners how much millis() has advanced during sleep
+ * @param ms  time credited during the whole sleep
+ */
+static
+void _notifyTimeListeners(uint32_t ms)
+{
+	if (!ms) return;
+	for (uint8_t i=0; i<MY_SNOOZE_MAX_TIME_LISTENERS; i++)
+		if (timeListeners[i]) timeListeners[i](ms);
+}
+
+//----- sleep/wake trace
+
+#if defined(MY_SNOOZE_TRACE)
+
+static_assert(MY_SNOOZE_TRACE >= 1 && MY_SNOOZE_TRACE <= 0x7FFF, "MY_SNOOZE_TRACE must be 1..32767");
+
+static snoozeTraceEntry_t traceBuf[MY_SNOOZE_TRACE];
+static uint16_t traceHead;		// index of next entry to write
+static uint16_t traceCount;		// number of valid entries
+
+
+/**
+ * @brief add one entry to trace ring buffer, overwriting oldest entry if full
+ */
+static
+void _traceRecord(uint32_t requestedMS, uint32_t slept, uint32_t awake, int8_t why)
+{
+	snoozeTraceEntry_t* e = &traceBuf[traceHead];
+	e->requestedMS = requestedMS;
+	e->sleptMS = slept;
+	e->awakeMS = awake;
+	e->napMS = wakeNapMS;
+	e->why = why;
+	if (++traceHead >= MY_SNOOZE_TRACE) traceHead = 0;
+	if (traceCount < MY_SNOOZE_TRACE) traceCount++;
+}
+
+
+/**
+ * @brief Get number of entries in trace buffer
+ */
+uint16_t snoozeTraceCount()
+{
+	return traceCount;
+}
+
+
+/**
+ * @brief Get trace entry 
+ * @param i   index, 0 is oldest entry
+ * @return pointer to entry, or NULL if `i` is out of range
+ */
+const snoozeTraceEntry_t* snoozeTraceGet(uint16_t i)
+{
+	if (i >= traceCount) return NULL;
+	uint16_t k = traceHead + MY_SNOOZE_TRACE - traceCount + i;	// < 2*MY_SNOOZE_TRACE
+	if (k >= MY_SNOOZE_TRACE) k -= MY_SNOOZE_TRACE;
+	return &traceBuf[k];
+}
+
+
+/**
+ * @brief Print all trace entries, oldest first, one line per snooze() call:
+ * `T:<requested ms>,<slept ms>,<awake ms before>,<result>,<interrupted nap ms>`
+ */
+void snoozeTraceDump(Print& out)
+{
+	for (uint16_t i=0; i<traceCount; i++) {
+		const snoozeTraceEntry_t* e = snoozeTraceGet(i);
+		out.print(F("T:"));
+		out.print(e->requestedMS);	out.print(',');
+		out.print(e->sleptMS);		out.print(',');
+		out.print(e->awakeMS);		out.print(',');
+		out.print(e->why);			out.print(',');
+		out.println(e->napMS);
+	}
+}
+
+
+/**
+ * @brief Remove all entries from trace buffer
+ */
+void snoozeTraceClear()
+{
+	traceHead = traceCount = 0;
+}
+
+#endif // MY_SNOOZE_TRACE
+
+//----- histograms
+
+#if defined(MY_SNOOZE_HISTOGRAMS)
+
+static uint16_t histograms[SNOOZE_N_HIST][MY_SNOOZE_HIST_BUCKETS];
+
+
+/**
+ * @brief count value in histogram bucket floor(log2(value))+1, or bucket 0 for value 0
+ */
+static
+void _histAdd(uint8_t which, uint32_t value)
+{
+	uint8_t bucket = 0;
+	while (value && bucket < MY_SNOOZE_HIST_BUCKETS-1) {
+		value >>= 1;
+		bucket++;
+	}
+	uint16_t* p = &histograms[which][bucket];
+	if (*p != UINT16_MAX) (*p)++;
+}
+
+
+/**
+ * @brief Get histogram 
+ * @param which   SNOOZE_HIST_REQUESTED etc
+ * @return array of MY_SNOOZE_HIST_BUCKETS counters, bucket n>0 counts values 2^(n-1) .. 2^n-1,
+ *         the last bucket also counts all larger values
+ */
+const uint16_t* snoozeStatsHistogram(uint8_t which)
+{
+	return histograms[which];
+}
+
+
+#endif // MY_SNOOZE_HISTOGRAMS
+
+//----- radio on-time meter
+
+#if defined(MY_SNOOZE_RADIO_METER)
+
+static bool radioOn = true;			// radio is powered after reset
+static uint32_t radioOnSinceMS;		// millis() when radio was last turned on
+static uint32_t radioOnMS;			// accumulated on-time since statistics were cleared
+
+
+/**
+ * @brief radio is going to sleep, add time since it was turned on
+ */
+static
+void _radioMeterOff()
+{
+	if (!radioOn) return;
+	radioOn = false;
+	radioOnMS += hwMillis() - radioOnSinceMS;
+}
+
+
+/**
+ * @brief Tell meter that the radio is active. Called by snooze() itself when it uses
+ * the radio, call it from the MySensors `indication()` handler for INDICATION_TX
+ * to catch the first transmission after waking up. The meter can't see the transport 
+ * switching the radio to receive mode when it is polled after wakeup (e.g. RFM69),
+ * call it right after snooze() returns to include that time.
+ */
+void snoozeRadioActivity()
+{
+	if (radioOn) return;
+	radioOn = true;
+	radioOnSinceMS = hwMillis();
+}
+
+
+/**
+ * @brief Get time the radio has been powered since statistics were last cleared
+ * @return milliseconds
+ */
+uint32_t snoozeStatsRadioOnMS()
+{
+	uint32_t ms = radioOnMS;
+	if (radioOn) ms += hwMillis() - radioOnSinceMS;
+	return ms;
+}
+
+#endif // MY_SNOOZE_RADIO_METER
+
+#if defined(MY_SNOOZE_HISTOGRAMS) || defined(MY_SNOOZE_RADIO_METER)
+
+/**
+ * @brief Print all statistics: one line `H<which>:<count0>,<count1>,...` per histogram,
+ * and one line `R:<ms>` with radio on-time
+ */
+void snoozeStatsDump(Print& out)
+{
+#if defined(MY_SNOOZE_HISTOGRAMS)
+	for (uint8_t h=0; h<SNOOZE_N_HIST; h++) {
+		out.print('H');
+		out.print(h);
+		for (uint8_t i=0; i<MY_SNOOZE_HIST_BUCKETS; i++) {
+			out.print(i ? ',' : ':');
+			out.print(histograms[h][i]);
+		}
+		out.println();
+	}
+#endif
+#if defined(MY_SNOOZE_RADIO_METER)
+	out.print(F("R:"));
+	out.println(snoozeStatsRadioOnMS());
+#endif
+}
+
+
+/**
+ * @brief Reset all statistics, starts a new measurement period
+ */
+void snoozeStatsClear()
+{
+#if defined(MY_SNOOZE_HISTOGRAMS)
+	memset(histograms, 0, sizeof(histograms));
+#endif
+#if defined(MY_SNOOZE_RADIO_METER)
+	radioOnMS = 0;
+	radioOnSinceMS = hwMillis();
+#endif
+}
+
+#endif
+
+#if defined(MY_SNOOZE_TRACE) || defined(MY_SNOOZE_HISTOGRAMS)
+
+static uint32_t enterMS;		// millis() when snooze() was called
+static uint32_t leaveMS;		// millis() when snooze() last returned
+
+
+/**
+ * @brief record one call to snooze() in trace and histograms
+ */
+static
+void _recordSnooze(uint32_t requestedMS, uint32_t slept, int8_t why)
+{
+	const uint32_t awake = enterMS - leaveMS;
+#if defined(MY_SNOOZE_TRACE)
+	_traceRecord(requestedMS, slept, awake, why);
+#else
+	(void)why;
+#endif
+#if defined(MY_SNOOZE_HISTOGRAMS)
+	_histAdd(SNOOZE_HIST_REQUESTED, requestedMS);
+	_histAdd(SNOOZE_HIST_SLEPT, slept);
+	_histAdd(SNOOZE_HIST_AWAKE, awake);
+#endif
+	leaveMS = hwMillis();
+}
+
+#define SNOOZE_RECORD
+
+#endif
+
+//----- sleep preparation and cleanup, common to snooze() and snoozeStep()
+
+#if defined(MY_SNOOZE_RADIO_POLICY)
+static uint8_t radioState;		// radio state selected for current sleep
+#endif
+static uint32_t sleptTotalMS;	// time credited to millis() during all steps of current sleep
+
+static bool stepActive;			// sleep started by snoozeBegin() has not ended yet
+static bool stepForever;		// ... and sleeps until interrupt
+static uint32_t stepRemainingMS;
+static uint32_t stepRequestedMS;
+
+
+/**
+ * @brief prepare for sleep: wait for transport, notify controller, power down radio
  * 
- * @param sleepingMS  sleep time in milliseconds, or 0 for 'forever'
- * @param smartSleep  if true, notify gateway before going to sleep
- * @return int8_t     reason for return from sleep, 
- *                    value returned by tick(),
- *                    or MY_WAKE_UP_BY_TIMER,
- *                    or MY_SLEEP_NOT_POSSIBLE
+ * @param sleepingMS       sleep time requested
+ * @param smartSleep       if true, notify gateway before going to sleep
+ * @param sleepingTimeMS   out: sleep time remaining after waiting for transport
+ * @return 0 if ready to sleep, or MY_SLEEP_NOT_POSSIBLE
  */
-int8_t snooze(const uint32_t sleepingMS, const bool smartSleep)
+static
+int8_t _snoozeEnter(const uint32_t sleepingMS, const bool smartSleep, uint32_t& sleepingTimeMS)
 {
 	CORE_DEBUG(PSTR("MCO:SLP:MS=%lu,SMS=%d\n"), sleepingMS, smartSleep);
-	uint32_t sleepingTimeMS = sleepingMS;
+#if defined(SNOOZE_RECORD)
+	enterMS = hwMillis();
+#endif
+	sleptTotalMS = 0;
+	sinceTick = 0;
+#if defined(MY_SNOOZE_TRACE)
+	wakeNapMS = 0;
+#endif
+	sleepingTimeMS = sleepingMS;
+#if !defined(MY_SNOOZE_STANDALONE)
 	// Do not sleep if transport not ready
 	if (!isTransportReady()) {
 		CORE_DEBUG(PSTR("!MCO:SLP:TNR\n"));	// sleeping not possible, transport not ready
+#if defined(MY_SNOOZE_RADIO_METER)
+		snoozeRadioActivity();
+#endif
 		const uint32_t sleepEnterMS = hwMillis();
 		uint32_t sleepDeltaMS = 0;
 		while (
@@ -277,23 +980,376 @@ int8_t snooze(const uint32_t sleepingMS, const bool smartSleep)
 			CORE_DEBUG(PSTR("MCO:SLP:MS=%lu\n"), sleepingTimeMS);
 		} else {
 			// no sleeping time left
+#if defined(SNOOZE_RECORD)
+			_recordSnooze(sleepingMS, 0, MY_SLEEP_NOT_POSSIBLE);
+#endif
 			return MY_SLEEP_NOT_POSSIBLE;
 		}
 	}
 
 	if (smartSleep) {
 		// notify controller about going to sleep
+#if defined(MY_SNOOZE_RADIO_METER)
+		snoozeRadioActivity();
+#endif
 		(void)sendHeartbeat();
 		wait(MY_SMART_SLEEP_WAIT_DURATION_MS);		// listen for incoming messages
 	}
 
 	CORE_DEBUG(PSTR("MCO:SLP:TPD\n"));	// sleep, power down transport
+#if defined(MY_SNOOZE_RADIO_POLICY)
+	radioState = _radioEnter(sleepingTimeMS);
+#else
 	transportDisable();
+#if defined(MY_SNOOZE_RADIO_METER)
+	_radioMeterOff();
+#endif
+#endif
 	setIndication(INDICATION_SLEEP);
+#else
+	(void)smartSleep;
+#endif // MY_SNOOZE_STANDALONE
+	// forget interrupts from before sleep, once for all steps
+	wokeUpWhy = 0;
+	return 0;
+}
 
-	int8_t result = mySleep(sleepingTimeMS);
 
+/**
+ * @brief after each call to mySleep(): add up sleep time, listeners are notified once in _snoozeLeave()
+ */
+static
+void _afterSleep()
+{
+	sleptTotalMS += sleptMS;
+}
+
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+ * @brief when the whole sleep is over: if not enough energy is stored to do any work, 
+ * keep napping until supply voltage has recovered
+ * @param why  value that ended sleep
+ * @return     `why`, or first value returned by tick() or ISR while napping if `why` is MY_WAKE_UP_BY_TIMER
+ */
+static
+int8_t _vccGate(int8_t why)
+{
+	while (vccOnMV && !_vccOK()) {
+		const int8_t later = mySleep(MY_SNOOZE_VCC_RECHECK_MS, false);
+		_afterSleep();
+		if (why == MY_WAKE_UP_BY_TIMER) why = later;
+	}
+	return why;
+}
+
+#endif
+
+
+/**
+ * @brief clean up after sleep has ended: bring radio back if necessary, notify time listeners 
+ * of all steps and voltage rechecks at once, record statistics
+ */
+static
+void _snoozeLeave(const uint32_t sleepingMS, const int8_t result)
+{
+	_notifyTimeListeners(sleptTotalMS);
+#if !defined(MY_SNOOZE_STANDALONE)
+#if defined(MY_SNOOZE_RADIO_POLICY)
+	_radioLeave(radioState);
+#endif
 	setIndication(INDICATION_WAKEUP);
+#endif
 	CORE_DEBUG(PSTR("MCO:SLP:WUP=%d\n"), result);	// sleep wake-up
+#if defined(SNOOZE_RECORD)
+	_recordSnooze(sleepingMS, sleptTotalMS, result);
+#else
+	(void)sleepingMS;
+	(void)result;
+#endif
+}
+
+//----- public functions
+
+/**
+ * @brief Install a function that decides whether an interrupt wakeup is genuine.
+ * The filter is called right after an interrupt has ended a nap, with the value of
+ * `wokeUpWhy`. If it returns 0, the wakeup is ignored and sleep continues for the
+ * remaining time, otherwise sleep ends and the returned value is passed to the caller.
+ * 
+ * @param filter  filter function, or NULL to accept all interrupts
+ * @return previously installed filter, so filters can be chained
+ */
+wakeFilter_t snoozeSetWakeFilter(wakeFilter_t filter)
+{
+	wakeFilter_t prev = wakeFilter;
+	wakeFilter = filter;
+	return prev;
+}
+
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+ * @brief Register a sensor conversion for snoozeConvertAll().
+ * 
+ * @param conv  conversion with start and read functions and time needed,
+ *              static or zero-initialized, must remain valid
+ */
+void snoozeAddConversion(snoozeConversion_t* conv)
+{
+	for (snoozeConversion_t* c = conversionList; c; c = c->next)
+		if (c == conv) return;
+	conv->next = conversionList;
+	conversionList = conv;
+}
+
+
+/**
+ * @brief Start all registered sensor conversions, sleep until the slowest one is done,
+ * then read all results. Awake time is the maximum of all conversion times, not the sum.
+ * Sleep uses the same naps as snooze(), with `millis()` corrected, but doesn't touch 
+ * the radio, and the ADC is off, so conversions must not use the internal ADC.
+ * Remaining time shorter than the shortest nap, and remaining time after an interrupt,
+ * is spent in delay().
+ * 
+ * @return MY_WAKE_UP_BY_TIMER, or first value returned by tick() or ISR while waiting;
+ *         results are read only after the full conversion time in either case
+ */
+int8_t snoozeConvertAll()
+{
+	wokeUpWhy = 0;
+	uint16_t wait = 0;
+	for (snoozeConversion_t* c = conversionList; c; c = c->next) {
+		c->start();
+		if (c->waitMS > wait) wait = c->waitMS;
+	}
+
+	int8_t result = MY_WAKE_UP_BY_TIMER;
+	const uint32_t start = millis();
+	uint32_t elapsed;
+	uint32_t slept = 0;
+	while ((elapsed = millis() - start) < wait) {
+		const uint32_t left = wait - elapsed;
+		// after an interrupt, millis() misses the unknown part of the interrupted nap, 
+		// and more interrupts might keep us from ever reaching `wait`: stay awake instead
+		if (result != MY_WAKE_UP_BY_TIMER || _napFor(left) == WDTO_SLEEP_FOREVER) {
+			delay(left);
+			break;
+		}
+		result = mySleep(left, false);
+		slept += sleptMS;
+	}
+	_notifyTimeListeners(slept);
+
+	for (snoozeConversion_t* c = conversionList; c; c = c->next)
+		c->read();
+	return result;
+}
+
+
+/**
+ * @brief Merge bursts of interrupts into one wakeup.
+ * After an interrupt has ended sleep, keep napping for `ms` milliseconds, and count
+ * further interrupts, OR-ing their `wokeUpWhy` values into the value returned by snooze().
+ * Interrupts rejected by the wake filter are not counted. Only values 1..127 that the 
+ * wake filter passes unchanged are merged, so the result is never negative; a value 
+ * translated by the filter (e.g. a key code) ends sleep right away and is returned as is.
+ * Tasks and tick() keep running during the window, and end it if they end sleep.
+ * 
+ * @param ms  window in milliseconds, 0 to end sleep on first interrupt (default)
+ */
+void snoozeSetCoalesceWindow(uint16_t ms)
+{
+	coalesceMS = ms;
+}
+
+
+/**
+ * @brief Get number of interrupts merged into the last wakeup
+ * @return 0 if last sleep didn't end by interrupt, or coalescing is disabled
+ */
+uint8_t snoozeBurstCount()
+{
+	return burstCount;
+}
+
+#endif // MY_SNOOZE_MINIMAL
+
+
+/**
+ * @brief Sleep once for a short watchdog period, e.g. to let signals settle.
+ * Can be called from `tick()` or from a wake filter, `millis()` is advanced accordingly.
+ * 
+ * @param wdto  nap duration (WDTO_15MS, WDTO_30MS etc)
+ */
+void snoozeNap(const uint8_t wdto)
+{
+	_doPowerDown(wdto);
+	_credit(pgm_read_word(&napTable[wdto]));
+}
+
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+ * @brief Start a resumable task, which will run between naps during snooze(), until it ends.
+ * The task runs first at the beginning of the next sleep, and then whenever the time 
+ * requested by TASK_SLEEP() has passed. Naps are shortened as needed. A task may span
+ * multiple calls to snooze(), and keeps the node napping even if snooze() was called
+ * to sleep until interrupt.
+ * 
+ * @param task  task state, static or zero-initialized, must remain valid until task has ended
+ * @param func  task function, using TASK_BEGIN(), TASK_SLEEP() and TASK_END()
+ */
+void snoozeStartTask(snoozeTask_t* task, snoozeTaskFunc_t func)
+{
+	const bool listed = (task->func != NULL);	// restart task that is still running
+	task->func = func;
+	task->lc = 0;
+	task->due = millis();
+	if (!listed) {
+		task->next = taskList;
+		taskList = task;
+	}
+}
+
+
+/**
+ * @brief Only return from sleep if supply voltage is high enough, e.g. for energy harvesting.
+ * When sleep would end, supply voltage is measured, and if too low, sleep continues in
+ * naps of MY_SNOOZE_VCC_RECHECK_MS. Once voltage has reached `onMV`, sleep ends normally
+ * until it has dropped below `offMV`.
+ * 
+ * @param onMV   voltage in mV needed to resume work, 0 to disable gating
+ * @param offMV  voltage in mV below which work is suspended, should be < onMV
+ */
+void snoozeSetVccThreshold(uint16_t onMV, uint16_t offMV)
+{
+	vccOnMV = onMV;
+	vccOffMV = offMV;
+	vccHigh = true;
+}
+
+
+/**
+ * @brief Register a function to be called once after each snooze(), with the number
+ * of milliseconds that millis() has been advanced by while sleeping. A sleep done in 
+ * steps by snoozeStep() is reported once when it has ended, including naps while 
+ * waiting for supply voltage; snoozeConvertAll() also reports its sleep once.
+ * 
+ * @param listener  function to call
+ * @return true if registered, false if all MY_SNOOZE_MAX_TIME_LISTENERS slots are in use
+ */
+bool snoozeAddTimeListener(timeListener_t listener)
+{
+	for (uint8_t i=0; i<MY_SNOOZE_MAX_TIME_LISTENERS; i++) {
+		if (timeListeners[i] == listener) return true;
+		if (!timeListeners[i]) {
+			timeListeners[i] = listener;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * @brief Unregister a function previously registered with snoozeAddTimeListener()
+ */
+void snoozeRemoveTimeListener(timeListener_t listener)
+{
+	for (uint8_t i=0; i<MY_SNOOZE_MAX_TIME_LISTENERS; i++)
+		if (timeListeners[i] == listener) timeListeners[i] = NULL;
+}
+
+#endif // MY_SNOOZE_MINIMAL
+
+
+/**
+ * @brief  Sleep for a defined time or forever, wake up when interrupt or when tick() returned !=0.
+ * Uses watchdog timer to sleep, periodically calls `tick()` function if defined
+ * 
+ * @param sleepingMS  sleep time in milliseconds, or 0 for 'forever'
+ * @param smartSleep  if true, notify gateway before going to sleep
+ * @return int8_t     reason for return from sleep, 
+ *                    value returned by tick(),
+ *                    or MY_WAKE_UP_BY_TIMER,
+ *                    or MY_SLEEP_NOT_POSSIBLE
+ */
+int8_t snooze(const uint32_t sleepingMS, const bool smartSleep)
+{
+	uint32_t sleepingTimeMS;
+	int8_t result = _snoozeEnter(sleepingMS, smartSleep, sleepingTimeMS);
+	if (result) return result;
+
+	result = mySleep(sleepingTimeMS, true);
+	_afterSleep();
+#if !defined(MY_SNOOZE_MINIMAL)
+	result = _vccGate(result);
+#endif
+
+	_snoozeLeave(sleepingMS, result);
+	return result;
+}
+
+
+/**
+ * @brief  Start a sleep that is performed in steps by snoozeStep(), so the main loop 
+ * can do other work in between. Same preparation as snooze(), i.e. the radio is
+ * powered down until the sleep has ended.
+ * 
+ * @param sleepingMS  sleep time in milliseconds, or 0 for 'forever'
+ * @param smartSleep  if true, notify gateway before going to sleep
+ * @return int8_t     SNOOZE_PENDING if sleep has started,
+ *                    or MY_SLEEP_NOT_POSSIBLE
+ */
+int8_t snoozeBegin(const uint32_t sleepingMS, const bool smartSleep)
+{
+	if (stepActive) return MY_SLEEP_NOT_POSSIBLE;
+	int8_t result = _snoozeEnter(sleepingMS, smartSleep, stepRemainingMS);
+	if (result) return result;
+	stepRequestedMS = sleepingMS;
+	stepForever = (sleepingMS == 0);
+	stepActive = true;
+	return SNOOZE_PENDING;
+}
+
+
+/**
+ * @brief  Continue sleep started by snoozeBegin(), for at most `maxMS` milliseconds.
+ * 
+ * @param maxMS   max time to sleep in this step, e.g. time until other work in
+ *                the main loop is due, or 0 to sleep until the whole sleep has ended;
+ *                values below 15 are rounded up to the shortest nap
+ * @return int8_t SNOOZE_PENDING if sleep time is not over yet, or same values as snooze()
+ */
+int8_t snoozeStep(const uint32_t maxMS)
+{
+	if (!stepActive) return MY_SLEEP_NOT_POSSIBLE;
+	uint32_t chunk = stepRemainingMS;			// 0 if sleeping forever
+	if (maxMS && (stepForever || maxMS < chunk)) {
+		chunk = (maxMS < 15) ? 15 : maxMS;		// at least one nap, so every step makes progress
+		if (!stepForever && chunk > stepRemainingMS) chunk = stepRemainingMS;
+	}
+	const bool last = !stepForever && chunk == stepRemainingMS;
+
+	int8_t result = mySleep(chunk, last);
+	_afterSleep();
+
+	if (result == MY_WAKE_UP_BY_TIMER && chunk && !last) {
+		// naps may not fill the chunk exactly, the rest is slept in later steps
+		if (!stepForever) stepRemainingMS -= (sleptMS < stepRemainingMS) ? sleptMS : stepRemainingMS;
+		if (stepForever || stepRemainingMS >= 15) return SNOOZE_PENDING;
+		// naps are at least 15ms, shorter remainders are not slept, same as in snooze()
+		const int8_t why = _callTick();
+		if (why) result = why;
+	}
+#if !defined(MY_SNOOZE_MINIMAL)
+	result = _vccGate(result);
+#endif
+	stepActive = false;
+	_snoozeLeave(stepRequestedMS, result);
 	return result;
 }
@@ -30,7 +30,8 @@
        and if it returns a value !=0, then sleep will end, and that value returned
 
     3. if an application-defined ISR sets global variable `wokeUpWhy`
-       to a value != INVALID_INTERRUPT_NUM, then sleep will end, and the value in `wokeUpWhy` returned
+       to a value != INVALID_INTERRUPT_NUM, then sleep will end, and the value in `wokeUpWhy` returned.
+       If a wake filter is installed, it may reject the interrupt, and sleep continues.
 
     if ms==0, sleep forever (i.e. until interrupt)
     if ms!=0, sleep for defined time, and correct millis() counter as best as possible
@@ -39,6 +40,34 @@
 #ifndef __BW_SLEEP2_H
 #define __BW_SLEEP2_H
 
+//----- configuration -------------------------------------------------------
+
+// MY_SNOOZE_STANDALONE : use without MySensors, e.g. on ATtiny
+// MY_SNOOZE_MINIMAL    : leave out resumable tasks, time listeners, voltage gating, coalescing 
+//                        and sensor conversions, for small flash
+
+#ifndef MY_SNOOZE_MAX_TIME_LISTENERS
+#define MY_SNOOZE_MAX_TIME_LISTENERS	(4)	//!< max number of functions registered with snoozeAddTimeListener()
+#endif
+
+#ifndef MY_SNOOZE_VCC_RECHECK_MS
+#define MY_SNOOZE_VCC_RECHECK_MS		(8000)	//!< nap time while supply voltage is too low
+#endif
+
+#ifndef MY_SNOOZE_BANDGAP_MV
+#define MY_SNOOZE_BANDGAP_MV			(1100)	//!< internal reference voltage, adjust for calibration
+#endif
+
+#if defined(MY_SNOOZE_STANDALONE)
+#include <stdint.h>
+#ifndef MY_WAKE_UP_BY_TIMER
+#define MY_WAKE_UP_BY_TIMER		((int8_t)-1)	//!< same value as in MySensors
+#endif
+#ifndef MY_SLEEP_NOT_POSSIBLE
+#define MY_SLEEP_NOT_POSSIBLE	((int8_t)-2)	//!< same value as in MySensors
+#endif
+#endif
+
 //----- new sleep function --------------------------------------------------
 
 // application ISR must set this variable to !=0
@@ -53,8 +82,29 @@ extern volatile uint8_t wokeUpWhy;
   */
 int8_t snooze( const uint32_t ms, const bool smart=false );
 
+//----- non-blocking sleep ---------------------------------------------------
+
+#define SNOOZE_PENDING	(0)		//!< returned by snoozeBegin() and snoozeStep() while sleep is not over
+
+/**
+  * @brief Start sleep, to be continued by calls to snoozeStep().
+  * 
+  * @param ms    = desired sleep time in milliseconds, or 0 for 'forever'
+  * @param smart = if true, notify controller before going to sleep
+  * @return SNOOZE_PENDING, or MY_SLEEP_NOT_POSSIBLE
+  */
+int8_t snoozeBegin( const uint32_t ms, const bool smart=false );
+
+/**
+  * @brief Sleep for at most `maxMS` ms, or until sleep started by snoozeBegin() has ended.
+  * 
+  * @param maxMS = max sleep time in this step, 0 for no limit, at least 15ms are slept
+  * @return SNOOZE_PENDING if sleep not over yet, otherwise same as snooze()
+  */
+int8_t snoozeStep( const uint32_t maxMS );
+
 /**
-  * @brief Called at least every 8s during sleep. Must be defiend by application.
+  * @brief Called at least every 8s during timed sleep. Must be defiend by application.
   * @return !=0 to wake up
  
   * - don't use ADC in this callback function, it may be disabled
@@ -63,5 +113,236 @@ int8_t snooze( const uint32_t ms, const bool smart=false );
   */
 int8_t tick(void) __attribute__((weak));
 
+/**
+  * @brief Called after an interrupt ended a nap, with the value of `wokeUpWhy`.
+  * @return 0 to ignore the interrupt and continue sleeping, 
+  *         or !=0 to wake up and return that value from snooze()
+  */
+typedef int8_t (*wakeFilter_t)(int8_t why);
+
+/**
+  * @brief Install application function to validate interrupt wakeups, NULL to accept all.
+  * @return previously installed filter
+  */
+wakeFilter_t snoozeSetWakeFilter(wakeFilter_t filter);
+
+/**
+  * @brief Sleep once for WDTO_15MS, WDTO_30MS etc, can be called from tick() or wake filter.
+  */
+void snoozeNap(const uint8_t wdto);
+
+/**
+  * @brief Called once after each snooze(), after the last snoozeStep() of a sleep,
+  * and after snoozeConvertAll(), with the number of milliseconds that millis() 
+  * has been advanced by during sleep.
+  */
+typedef void (*timeListener_t)(uint32_t ms);
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+  * @brief Register function to be notified of time advanced during sleep.
+  * @return false if no free slot
+  */
+bool snoozeAddTimeListener(timeListener_t listener);
+
+/**
+  * @brief Unregister function registered with snoozeAddTimeListener().
+  */
+void snoozeRemoveTimeListener(timeListener_t listener);
+
+/**
+  * @brief Measure supply voltage via bandgap reference, in mV.
+  */
+uint16_t snoozeReadVcc();
+
+/**
+  * @brief Only end sleep if supply voltage >= onMV, until it drops below offMV. onMV=0 to disable.
+  */
+void snoozeSetVccThreshold(uint16_t onMV, uint16_t offMV);
+
+#endif // MY_SNOOZE_MINIMAL
+
+
+//----- bursts of interrupts, concurrent sensor conversions -----------------
+
+/// a slow sensor reading, split into start and read, e.g. DS18B20 or SHT3x
+typedef struct snoozeConversion_s {
+	void						(*start)(void);	//!< start conversion
+	void						(*read)(void);	//!< read result, store it somewhere
+	uint16_t					waitMS;			//!< time needed between start and read
+	struct snoozeConversion_s*	next;			//!< next conversion in list
+} snoozeConversion_t;
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+  * @brief After first interrupt, keep napping for `ms`, merge further interrupts (OR-ed `wokeUpWhy`).
+  * Only values 1..127 not changed by the wake filter are merged, others end sleep immediately.
+  */
+void snoozeSetCoalesceWindow(uint16_t ms);
+
+/**
+  * @brief Number of interrupts merged into last wakeup.
+  */
+uint8_t snoozeBurstCount();
+
+/**
+  * @brief Register conversion for snoozeConvertAll().
+  */
+void snoozeAddConversion(snoozeConversion_t* conv);
+
+/**
+  * @brief Start all conversions, sleep once for the longest conversion time, read all results.
+  * @return MY_WAKE_UP_BY_TIMER, or value from tick() or ISR that occurred while waiting
+  */
+int8_t snoozeConvertAll();
+
+#endif // MY_SNOOZE_MINIMAL
+
+//----- resumable tasks -----------------------------------------------------
+
+struct snoozeTask_s;
+typedef int8_t (*snoozeTaskFunc_t)(struct snoozeTask_s* task);
+
+/// state of a resumable task
+typedef struct snoozeTask_s {
+	snoozeTaskFunc_t		func;	//!< task function, NULL if not running
+	struct snoozeTask_s*	next;	//!< next task in list
+	uint32_t				due;	//!< millis() value when task wants to continue
+	uint16_t				lc;		//!< line number where task continues
+} snoozeTask_t;
+
+#define TASK_DONE	(0xFFFFu)	//!< value of `lc` after task has ended
+
+/**
+ * A task function is called between naps, so keep it short. The ADC is enabled while
+ * tasks run if it was enabled before sleep, and serial output is flushed before the next nap.
+ * It uses local continuations like protothreads: local variables are not preserved
+ * across TASK_SLEEP(), use static variables instead.
+ * Returning !=0 (via TASK_WAKE()) ends sleep with that value, like `tick()`.
+ * 
+ *  int8_t measure(snoozeTask_t* t) {
+ *    TASK_BEGIN(t);
+ *    digitalWrite(SENSOR_POWER,HIGH);
+ *    TASK_SLEEP(t,30);
+ *    value = readSensor();
+ *    digitalWrite(SENSOR_POWER,LOW);
+ *    TASK_END(t);
+ *  }
+ */
+#define TASK_BEGIN(t)		switch ((t)->lc) { case 0:
+#define TASK_SLEEP(t,ms)	do { (t)->due = millis() + (ms); (t)->lc = __LINE__; return 0; case __LINE__:; } while (0)
+#define TASK_WAKE(t,why)	do { (t)->lc = __LINE__; return (why); case __LINE__:; } while (0)
+#define TASK_END(t)			} (t)->lc = TASK_DONE; return 0
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+  * @brief Start resumable task, it will run between naps during snooze().
+  */
+void snoozeStartTask(snoozeTask_t* task, snoozeTaskFunc_t func);
+
+/**
+  * @brief true if task has been started and has not ended yet
+  */
+static inline bool snoozeTaskRunning(const snoozeTask_t* task) { return task->func != NULL; }
+
+#endif // MY_SNOOZE_MINIMAL
+
+//----- sleep/wake trace ----------------------------------------------------
+
+#if defined(MY_SNOOZE_TRACE)
+
+class Print;
+
+/// one call to snooze(), recorded if MY_SNOOZE_TRACE is defined as number of entries to keep
+typedef struct {
+	uint32_t	requestedMS;	//!< sleep time requested
+	uint32_t	sleptMS;		//!< sleep time credited to millis()
+	uint32_t	awakeMS;		//!< time awake since previous snooze() returned
+	uint16_t	napMS;			//!< nominal length of the nap an interrupt ended sleep in, not in sleptMS, 0 if none
+	int8_t		why;			//!< value returned by snooze()
+} snoozeTraceEntry_t;
+
+/**
+  * @brief Number of entries in trace buffer.
+  */
+uint16_t snoozeTraceCount();
+
+/**
+  * @brief Trace entry `i`, 0 is oldest, or NULL if out of range.
+  */
+const snoozeTraceEntry_t* snoozeTraceGet(uint16_t i);
+
+/**
+  * @brief Print trace, one line `T:requested,slept,awake,why,nap` per entry, oldest first.
+  */
+void snoozeTraceDump(Print& out);
+
+/**
+  * @brief Empty trace buffer.
+  */
+void snoozeTraceClear();
+
+#endif // MY_SNOOZE_TRACE
+
+//----- statistics ----------------------------------------------------------
+
+#if defined(MY_SNOOZE_HISTOGRAMS)
+
+#ifndef MY_SNOOZE_HIST_BUCKETS
+#define MY_SNOOZE_HIST_BUCKETS	(24)	//!< number of log2 buckets per histogram
+#endif
+
+/// histograms recorded if MY_SNOOZE_HISTOGRAMS is defined
+enum {
+	SNOOZE_HIST_REQUESTED,	//!< sleep time requested, ms
+	SNOOZE_HIST_SLEPT,		//!< sleep time credited to millis(), ms
+	SNOOZE_HIST_AWAKE,		//!< time awake between calls to snooze(), ms
+	SNOOZE_HIST_TICK,		//!< time spent in tick(), us
+	SNOOZE_N_HIST
+};
+
+/**
+  * @brief Histogram `which`, array of MY_SNOOZE_HIST_BUCKETS counters, 
+  * bucket 0 for value 0, bucket n for values 2^(n-1) .. 2^n-1.
+  */
+const uint16_t* snoozeStatsHistogram(uint8_t which);
+
+#endif // MY_SNOOZE_HISTOGRAMS
+
+#if defined(MY_SNOOZE_RADIO_METER)
+
+/**
+  * @brief Mark radio as active, call from `indication()` handler for INDICATION_TX
+  * (needs MY_INDICATION_HANDLER), or right after snooze() if the radio listens after 
+  * wakeup: receive mode entered by transport polling is not metered otherwise.
+  */
+void snoozeRadioActivity();
+
+/**
+  * @brief Time in ms the radio has been powered since statistics were cleared.
+  */
+uint32_t snoozeStatsRadioOnMS();
+
+#endif // MY_SNOOZE_RADIO_METER
+
+#if defined(MY_SNOOZE_HISTOGRAMS) || defined(MY_SNOOZE_RADIO_METER)
+
+class Print;
+
+/**
+  * @brief Print statistics, one line `H<which>:count0,count1,...` per histogram,
+  * and `R:ms` for radio on-time.
+  */
+void snoozeStatsDump(Print& out);
+
+/**
+  * @brief Reset statistics, start new measurement period.
+  */
+void snoozeStatsClear();
+
+#endif
 
 #endif // __BW_SLEEP2_H
@@ -0,0 +1,147 @@
+/**
+ * @file		  MySnoozeKeypad.cpp
+ *
+ * Tabsize		: 4
+ *
+ * This Revision: $Id$
+ */
+
+/*
+   Copyright (C) 2026 MySnooze contributors
+
+   This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0. 
+   If a copy of the MPL was not distributed with this file, You can obtain one at http://mozilla.org/MPL/2.0/
+
+   SPDX-License-Identifier: MPL-2.0
+*/
+
+/** 
+	@brief matrix keypad as wakeup source for snooze()
+ */
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include "MySnoozeKeypad.h"
+
+// needs pin change interrupts controlled by PCICR/PCIFR like on ATmega, ATtiny is not supported;
+// skipped there, because the Arduino IDE compiles all library sources
+#if defined(PCICR)
+
+//----- local variables -----------------------------------------------------
+
+static const uint8_t* kpRows;
+static const uint8_t* kpCols;
+static uint8_t kpNRows, kpNCols;
+static uint8_t kpPCICR;			// PCICR bits used by column pins
+static wakeFilter_t prevFilter;	// filter installed before keypadBegin(), for other wakeup sources
+
+//----- local functions -----------------------------------------------------
+
+/**
+ * @brief enable or disable pin change interrupts for column pins
+ */
+static
+void _arm(bool on)
+{
+	if (on) {
+		PCIFR = kpPCICR;		// forget changes caused by scanning
+		PCICR |= kpPCICR;
+	} else {
+		PCICR &= ~kpPCICR;
+	}
+}
+
+
+/**
+ * @brief wake filter: turn keypad interrupt into key code, pass other interrupts on
+ */
+static
+int8_t _keypadFilter(int8_t why)
+{
+	if (why != KEYPAD_WAKE) 
+		return prevFilter ? prevFilter(why) : why;
+
+	_arm(false);
+	int8_t key = keypadScan();
+	while (key) {
+		snoozeNap(MY_KEYPAD_DEBOUNCE_WDTO);
+		int8_t again = keypadScan();
+		if (again == key) break;
+		key = again;
+	}
+	_arm(true);
+	return key;		// 0 if released or noise, continue sleeping
+}
+
+//----- public functions ----------------------------------------------------
+
+bool keypadBegin( const uint8_t* rows, uint8_t nrows, const uint8_t* cols, uint8_t ncols )
+{
+	if ((uint16_t)nrows * ncols > KEYPAD_MAX_KEYS) return false;
+	kpRows = rows; kpNRows = nrows;
+	kpCols = cols; kpNCols = ncols;
+
+	kpPCICR = 0;
+	for (uint8_t c=0; c<ncols; c++) {
+		const uint8_t pin = cols[c];
+		pinMode(pin, INPUT_PULLUP);
+		*digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+		kpPCICR |= _BV(digitalPinToPCICRbit(pin));
+	}
+	for (uint8_t r=0; r<nrows; r++) {
+		pinMode(rows[r], OUTPUT);
+		digitalWrite(rows[r], LOW);
+	}
+	prevFilter = snoozeSetWakeFilter(_keypadFilter);
+	_arm(true);
+	return true;
+}
+
+
+void keypadEnd(void)
+{
+	_arm(false);
+	for (uint8_t c=0; c<kpNCols; c++) {
+		const uint8_t pin = kpCols[c];
+		*digitalPinToPCMSK(pin) &= ~_BV(digitalPinToPCMSKbit(pin));
+	}
+	for (uint8_t r=0; r<kpNRows; r++) 
+		pinMode(kpRows[r], INPUT);
+	snoozeSetWakeFilter(prevFilter);
+}
+
+
+int8_t keypadScan(void)
+{
+	int8_t key = 0;
+	// release all rows, then pull one row low at a time
+	for (uint8_t r=0; r<kpNRows; r++) 
+		pinMode(kpRows[r], INPUT);
+	for (uint8_t r=0; r<kpNRows && !key; r++) {
+		pinMode(kpRows[r], OUTPUT);
+		digitalWrite(kpRows[r], LOW);
+		delayMicroseconds(5);
+		for (uint8_t c=0; c<kpNCols; c++) {
+			if (digitalRead(kpCols[c]) == LOW) {
+				key = KEYPAD_KEY(r * kpNCols + c);
+				break;
+			}
+		}
+		pinMode(kpRows[r], INPUT);
+	}
+	// back to idle state: all rows low
+	for (uint8_t r=0; r<kpNRows; r++) {
+		pinMode(kpRows[r], OUTPUT);
+		digitalWrite(kpRows[r], LOW);
+	}
+	return key;
+}
+
+
+void keypadISR(void)
+{
+	wokeUpWhy = KEYPAD_WAKE;
+}
+
+#endif // PCICR
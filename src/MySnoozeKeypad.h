@@ -0,0 +1,79 @@
+/**
+ * @file       MySnoozeKeypad.h
+ *
+ * Tabsize		 : 4
+ *
+ * This Revision: $Id$
+ */
+
+/*
+   Copyright (C) 2026 MySnooze contributors
+
+   This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0. 
+   If a copy of the MPL was not distributed with this file, You can obtain one at http://mozilla.org/MPL/2.0/
+
+   SPDX-License-Identifier: MPL-2.0
+*/
+
+/**
+	@file MySnoozeKeypad.h
+	@brief wake up from snooze() by key press on a matrix keypad
+
+    call keypadBegin() once, then snooze() will end when a key is pressed, 
+    and return KEYPAD_KEY(n), n being the key index row*ncols+col.
+
+    While sleeping, all rows are driven low, and all columns are inputs with
+    pullup and pin change interrupt enabled, so the keypad draws no current 
+    until a key is pressed. After a pin change, the keypad is scanned, and 
+    scanned again after a short nap for debouncing. If no key is found, it 
+    was a bounce or noise, and sleep continues.
+
+    The application must define the ISR for the pin change interrupt(s) of
+    the column pins, and call keypadISR() from there, e.g.
+    `ISR(PCINT2_vect) { keypadISR(); }`
+
+    Needs pin change interrupts controlled by PCICR, as on ATmega328P etc,
+    ATtiny is not supported.
+*/
+
+#ifndef __MY_SNOOZE_KEYPAD_H
+#define __MY_SNOOZE_KEYPAD_H
+
+#include "MySnooze.h"
+
+#ifndef MY_KEYPAD_DEBOUNCE_WDTO
+#define MY_KEYPAD_DEBOUNCE_WDTO	WDTO_30MS	//!< nap between scans, for debouncing
+#endif
+
+#define KEYPAD_WAKE			(0x7F)			//!< value of `wokeUpWhy` set by keypadISR(), not a key code
+#define KEYPAD_KEY(n)		(0x40 | (n))	//!< value returned by snooze() for key n, 0x40..0x7E
+#define KEYPAD_MAX_KEYS		(63)			//!< max rows*cols, so that KEYPAD_KEY(n) != KEYPAD_WAKE
+
+/**
+  * @brief Set up keypad pins, and install wake filter.
+  * 
+  * @param rows   array of row pin numbers, driven low while waiting for key
+  * @param nrows  number of rows
+  * @param cols   array of column pin numbers, inputs with pullup and pin change interrupt
+  * @param ncols  number of columns
+  * @return false if too many keys
+  */
+bool keypadBegin( const uint8_t* rows, uint8_t nrows, const uint8_t* cols, uint8_t ncols );
+
+/**
+  * @brief Disable pin change interrupts, release row pins, and remove wake filter.
+  */
+void keypadEnd(void);
+
+/**
+  * @brief Scan keypad once.
+  * @return 0 if no key pressed, or KEYPAD_KEY(n) for first key found
+  */
+int8_t keypadScan(void);
+
+/**
+  * @brief Must be called from application ISR for pin change interrupt of column pins.
+  */
+void keypadISR(void);
+
+#endif // __MY_SNOOZE_KEYPAD_H
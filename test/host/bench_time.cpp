@@ -0,0 +1,193 @@
+/**
+ * @file       bench_time.cpp
+ *
+ * Timekeeping benchmark: a simulated week of snooze() cycles against a watchdog with
+ * skew, temperature drift and interrupt wakeups, reporting the error of millis() over
+ * time for three ways of crediting naps, all with the same workload:
+ *
+ *  - nominal:     as snooze() does it, nominal watchdog periods
+ *  - calibrated:  nominal periods scaled by a factor measured once at startup,
+ *                 by timing one 1s nap against the system clock
+ *  - disciplined: like calibrated, and every sync period, millis() is compared with a
+ *                 reference of 1s resolution (e.g. controller time from requestTime()),
+ *                 the offset is removed, and the scale factor is adjusted
+ *
+ * Corrections are applied by a time listener, as an application would do it.
+ * Interrupted naps are not credited by snooze(), so interrupts make millis() fall behind
+ * with every strategy, only the disciplined one catches up.
+ *
+ *   ./bench_time [-s skew%] [-t tempco%/C] [-a swingC] [-i irqS] [-p syncS] [-d days] [-m sleepMS]
+ *
+ * Real nap length is nominal * (1 + skew + tempco * (T - 25C)), with temperature T
+ * swinging by `swingC` around 20C once a day. Each cycle is 20ms awake and snooze(sleepMS),
+ * interrupts arrive at random, on average every `irqS` seconds, 0 for none.
+ * Prints one line `<hours> <nominal> <calibrated> <disciplined>` per 6 hours with
+ * millis() minus real time in ms, and a summary line starting with '#'.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include "MySnooze.h"
+#include "sim.h"
+
+extern volatile unsigned long timer0_millis;	// defined in sim.cpp, like in Arduino core wiring.c
+
+enum { NOMINAL, CALIBRATED, DISCIPLINED, N_STRATEGIES };
+static const char* const strategyName[N_STRATEGIES] = { "nominal", "calibrated", "disciplined" };
+
+static const uint32_t HOUR_MS = 3600000UL;
+static const uint32_t DAY_MS = 24 * HOUR_MS;
+static const uint32_t SAMPLE_MS = 6 * HOUR_MS;
+static const uint32_t AWAKE_MS = 20;
+
+// watchdog model
+static double skew = 0.03;			// +3%: naps are longer than nominal
+static double tempco = 0.0005;		// per degree C
+static double swingC = 10;
+
+// workload
+static uint32_t irqS = 1800;
+static uint32_t syncS = 3600;
+static uint32_t days = 7;
+static uint32_t sleepMS = 60000;
+
+//----- strategies
+
+static double scale;			// estimated real nap length / nominal
+static double residual;			// correction not yet applied to millis(), < 1ms
+static uint32_t creditedMS;		// time credited since last sync
+
+
+/**
+ * @brief time listener: add the difference between estimated and nominal nap length
+ */
+static void correct(uint32_t ms)
+{
+	residual += ms * (scale - 1.0);
+	const long adjust = lround(residual);
+	residual -= adjust;
+	timer0_millis += adjust;
+	creditedMS += ms;
+}
+
+
+/**
+ * @brief compare with reference time, remove offset, and adjust scale factor by half of
+ * the rate error seen since the last sync, to smooth out reference resolution and interrupts
+ */
+static void discipline()
+{
+	const uint32_t ref = (simNowMS + 500) / 1000 * 1000;
+	const int32_t err = (int32_t)(millis() - ref);
+	timer0_millis -= err;
+	if (creditedMS) scale -= 0.5 * err / creditedMS;
+	creditedMS = 0;
+}
+
+//----- simulation
+
+static void napModel(uint8_t)
+{
+	const double T = 20 + swingC * sin(2 * M_PI * (simNowMS % DAY_MS) / DAY_MS);
+	simWdtScale = 1 + skew + tempco * (T - 25);
+}
+
+
+/**
+ * @brief run the whole simulation with one strategy
+ * @param err  out: millis() error in ms at every sample time
+ */
+static void run(uint8_t strategy, std::vector<int32_t>& err)
+{
+	simReset();
+	simOnNap = napModel;
+	scale = 1.0;
+	residual = 0;
+	creditedMS = 0;
+
+	std::mt19937 rng(20261018);		// same interrupts for every strategy
+	std::exponential_distribution<double> gap(irqS ? 1.0 / irqS : 1.0);
+	if (irqS) {
+		for (double t = gap(rng); t * 1000 < (double)days * DAY_MS; t += gap(rng))
+			simInterrupt((uint32_t)(t * 1000), 1);
+	}
+
+	if (strategy != NOMINAL) {
+		const uint32_t before = simNowMS;
+		snoozeNap(WDTO_1S);
+		scale = (simNowMS - before) / 1000.0;
+		snoozeAddTimeListener(correct);
+	}
+
+	uint32_t nextSample = 0, nextSync = syncS * 1000;
+	while (simNowMS < days * DAY_MS) {
+		while (simNowMS >= nextSample) {
+			err.push_back((int32_t)(millis() - simNowMS));
+			nextSample += SAMPLE_MS;
+		}
+		if (strategy == DISCIPLINED && simNowMS >= nextSync) {
+			discipline();
+			nextSync += syncS * 1000;
+		}
+		delay(AWAKE_MS);
+		snooze(sleepMS);
+	}
+	snoozeRemoveTimeListener(correct);
+}
+
+
+int main(int argc, char** argv)
+{
+	for (int i=1; i<argc; i++) {
+		const char* opt = argv[i];
+		if (strlen(opt) != 2 || opt[0] != '-' || i+1 >= argc || !strchr("staipdm", opt[1])) {
+			fprintf(stderr, "usage: %s [-s skew%%] [-t tempco%%/C] [-a swingC] [-i irqS] [-p syncS] [-d days] [-m sleepMS]\n", argv[0]);
+			return 2;
+		}
+		const char* arg = argv[++i];
+		switch (opt[1]) {
+			case 's': skew = atof(arg) / 100; break;
+			case 't': tempco = atof(arg) / 100; break;
+			case 'a': swingC = atof(arg); break;
+			case 'i': irqS = atol(arg); break;
+			case 'p': syncS = atol(arg); break;
+			case 'd': days = atol(arg); break;
+			case 'm': sleepMS = atol(arg); break;
+		}
+	}
+	if (!syncS || !days || days > 40 || sleepMS < 15) {
+		fprintf(stderr, "need syncS > 0, days 1..40, sleepMS >= 15\n");
+		return 2;
+	}
+
+	std::vector<int32_t> err[N_STRATEGIES];
+	for (uint8_t s=0; s<N_STRATEGIES; s++)
+		run(s, err[s]);
+
+	printf("# skew=%.2f%% tempco=%.3f%%/C swing=%.0fC irq=%us sync=%us sleep=%ums\n",
+		skew * 100, tempco * 100, swingC, irqS, syncS, sleepMS);
+	printf("# hours %s %s %s (millis() - real time, ms)\n", strategyName[0], strategyName[1], strategyName[2]);
+	int32_t maxErr[N_STRATEGIES] = { 0 };
+	for (size_t k=0; k<err[0].size(); k++) {
+		printf("%zu", k * SAMPLE_MS / HOUR_MS);
+		for (uint8_t s=0; s<N_STRATEGIES; s++) {
+			const int32_t e = (k < err[s].size()) ? err[s][k] : 0;
+			printf(" %d", e);
+			if (abs(e) > maxErr[s]) maxErr[s] = abs(e);
+		}
+		printf("\n");
+	}
+	printf("# max |error| ms:");
+	for (uint8_t s=0; s<N_STRATEGIES; s++)
+		printf(" %s=%d", strategyName[s], maxErr[s]);
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file       replay.cpp
+ *
+ * Replay a sleep/wake trace recorded on a node with MY_SNOOZE_TRACE through the host 
+ * build of snooze(), e.g. with another coalescing window or other compile-time options
+ * (`make replay REPLAY_FLAGS=-D...`), to compare naps and wakeup latency offline.
+ *
+ *   ./replay [-c coalesceMS] [-w wakeUC] [-a activeMA] < trace.txt
+ *
+ * Reads lines `T:requested,slept,awake,result,nap` as printed by snoozeTraceDump(), 
+ * other lines are ignored, `nap` may be missing. Before each call the node is awake 
+ * for `awake` ms. A result other than MY_WAKE_UP_BY_TIMER is replayed as an interrupt 
+ * with that value, in the middle of the nap it interrupted, i.e. after `slept + nap/2` ms,
+ * because the interrupted nap is not credited to `slept`. The trace can't tell ISR values
+ * from tick() or task values, and a burst merged in a coalescing window is replayed as 
+ * one interrupt at its end.
+ * Prints the replayed trace in the same format, and a summary line starting with '#',
+ * with an estimate of the charge used: every nap costs `wakeUC` uC to wake up 
+ * (default 0.4uC, ATmega328P at 8MHz), and the node draws `activeMA` mA while awake 
+ * (default 5mA). Sleep current is left out, it is the same for every configuration.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "MySnooze.h"
+#include "sim.h"
+
+
+int main(int argc, char** argv)
+{
+	uint16_t coalesceMS = 0;
+	double wakeUC = 0.4, activeMA = 5.0;
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			coalesceMS = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-w") && i+1 < argc) {
+			wakeUC = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-a") && i+1 < argc) {
+			activeMA = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [-c coalesceMS] [-w wakeUC] [-a activeMA] < trace.txt\n", argv[0]);
+			return 2;
+		}
+	}
+
+	simReset();
+	snoozeSetCoalesceWindow(coalesceMS);
+
+	char line[128];
+	uint32_t calls = 0, wakeups = 0;
+	uint64_t sleptMS = 0, awakeMS = 0, latencyMS = 0;
+	while (fgets(line, sizeof(line), stdin)) {
+		unsigned long requested, slept, awake, nap = 0;
+		int why;
+		if (sscanf(line, "T:%lu,%lu,%lu,%d,%lu", &requested, &slept, &awake, &why, &nap) < 4) continue;
+		delay(awake);
+		awakeMS += awake;
+		if (why == MY_SLEEP_NOT_POSSIBLE) continue;
+
+		const uint32_t startMS = simNowMS;
+		const uint32_t start = millis();
+		const bool irq = (why != MY_WAKE_UP_BY_TIMER);
+		const uint32_t irqMS = startMS + slept + nap / 2;
+		if (irq) simInterrupt(irqMS, (uint8_t)why);
+		const int8_t result = snooze(requested);
+		simClearInterrupts();
+
+		const uint32_t credited = millis() - start;
+		const snoozeTraceEntry_t* e = snoozeTraceGet(snoozeTraceCount() - 1);
+		printf("T:%lu,%u,%lu,%d,%u\n", requested, credited, awake, result, e ? e->napMS : 0);
+		calls++;
+		sleptMS += simNowMS - startMS;
+		if (result != MY_WAKE_UP_BY_TIMER) {
+			wakeups++;
+			if (irq && simNowMS > irqMS) latencyMS += simNowMS - irqMS;
+		}
+	}
+	// uC = mA * ms / 1000
+	const double chargeUC = simNaps * wakeUC + awakeMS * activeMA / 1000;
+	printf("# calls=%u wakeups=%u naps=%u sleptMS=%llu awakeMS=%llu latencyMS=%llu chargeUC=%.0f\n",
+		calls, wakeups, simNaps, (unsigned long long)sleptMS, (unsigned long long)awakeMS,
+		(unsigned long long)latencyMS, chargeUC);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file       sim.cpp
+ *
+ * Host simulation of AVR registers, watchdog naps and Arduino time functions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+#include "MySnooze.h"
+#include "sim.h"
+
+//----- state
+
+uint32_t simNowMS;
+bool simIntEnabled = true;
+uint32_t simNaps;
+uint32_t simNapsByWdto[10];
+uint16_t simVccMV = 3300;
+uint32_t simVccReads;
+double simWdtScale = 1.0;
+void (*simOnNap)(uint8_t wdto);
+
+volatile unsigned long timer0_millis;
+
+simADCSRA_t ADCSRA;
+volatile uint8_t ADMUX;
+volatile uint16_t ADC;
+volatile uint8_t WDTCSR;
+
+static uint8_t wdtPeriod = SIM_FOREVER;
+static const uint16_t napMS[] = { 15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000 };
+
+struct simIrq_t { uint32_t atMS; uint8_t why; uint32_t everyMS; };
+static std::vector<simIrq_t> irqs;
+
+//----- control
+
+void simReset(uint32_t startMS)
+{
+	simNowMS = startMS;
+	timer0_millis = startMS;
+	simIntEnabled = true;
+	simNaps = 0;
+	for (uint32_t& n : simNapsByWdto) n = 0;
+	simVccMV = 3300;
+	simVccReads = 0;
+	simWdtScale = 1.0;
+	simOnNap = NULL;
+	irqs.clear();
+	wokeUpWhy = 0;
+}
+
+
+void simInterrupt(uint32_t atMS, uint8_t why, uint32_t everyMS)
+{
+	irqs.push_back({ atMS, why, everyMS });
+}
+
+
+void simClearInterrupts()
+{
+	irqs.clear();
+}
+
+//----- AVR
+
+simADCSRA_t& simADCSRA_t::operator=(uint8_t x)
+{
+	if (x & _BV(ADSC)) {
+		simVccReads++;
+		ADC = (uint16_t)(1100UL * 1024 / simVccMV);
+		x &= ~_BV(ADSC);		// conversion done at once
+	}
+	v = x;
+	return *this;
+}
+
+
+void cli() { simIntEnabled = false; }
+void sei() { simIntEnabled = true; }
+
+void wdt_enable(uint8_t wdto) { wdtPeriod = wdto; }
+void wdt_disable() { wdtPeriod = SIM_FOREVER; }
+void wdt_reset() {}
+
+
+void sleep_cpu()
+{
+	if (!simIntEnabled) {
+		fprintf(stderr, "sleep_cpu() with interrupts disabled, would never wake up\n");
+		abort();
+	}
+	simNaps++;
+	if (wdtPeriod != SIM_FOREVER) simNapsByWdto[wdtPeriod]++;
+	if (simOnNap) simOnNap(wdtPeriod);
+
+	uint32_t end = (wdtPeriod == SIM_FOREVER) ? UINT32_MAX : simNowMS + (uint32_t)(napMS[wdtPeriod] * simWdtScale + 0.5);
+	simIrq_t* first = NULL;
+	for (simIrq_t& q : irqs)
+		if (q.atMS <= end && (!first || q.atMS < first->atMS)) first = &q;
+	if (!first) {
+		if (wdtPeriod == SIM_FOREVER) {
+			fprintf(stderr, "sleep_cpu() forever without interrupt\n");
+			abort();
+		}
+		simNowMS = end;
+		return;
+	}
+	if (first->atMS > simNowMS) simNowMS = first->atMS;
+	wokeUpWhy = first->why;
+	if (first->everyMS) first->atMS = simNowMS + first->everyMS;
+	else irqs.erase(irqs.begin() + (first - irqs.data()));
+}
+
+//----- Arduino
+
+// unsigned long is 32 bits on AVR, overflow like there
+unsigned long millis() { return (uint32_t)timer0_millis; }
+unsigned long micros() { return (uint32_t)(timer0_millis * 1000UL); }
+
+void delay(unsigned long ms)
+{
+	simNowMS += ms;
+	timer0_millis += ms;
+}
+
+void delayMicroseconds(unsigned int) {}
+
+void Print::print(const char* s)		{ fputs(s, stdout); }
+void Print::print(char c)				{ putchar(c); }
+void Print::print(unsigned char n)		{ printf("%u", n); }
+void Print::print(int n)				{ printf("%d", n); }
+void Print::print(unsigned int n)		{ printf("%u", n); }
+void Print::print(long n)				{ printf("%ld", n); }
+void Print::print(unsigned long n)		{ printf("%lu", n); }
+void Print::println()					{ putchar('\n'); }
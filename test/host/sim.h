@@ -0,0 +1,43 @@
+/**
+ * @file       sim.h
+ *
+ * Host simulation of an AVR sleeping in watchdog naps, for testing MySnooze.cpp
+ * without hardware. Real time runs only in naps and delay(), millis() only 
+ * advances by what MySnooze credits to timer0_millis and by delay().
+ */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stdint.h>
+
+#define SIM_FOREVER		(0xFFu)		//!< wdto of a nap without watchdog
+
+extern uint32_t simNowMS;			//!< real time
+extern bool simIntEnabled;			//!< interrupt flag, like I bit in SREG
+extern uint32_t simNaps;			//!< number of sleep_cpu() calls
+extern uint32_t simNapsByWdto[10];	//!< ... per watchdog period
+extern uint16_t simVccMV;			//!< supply voltage seen by ADC
+extern uint32_t simVccReads;		//!< number of ADC conversions
+extern double simWdtScale;			//!< real nap length / nominal, e.g. 1.05 for a slow watchdog
+
+/// called at the start of every nap, e.g. to check state or schedule interrupts
+extern void (*simOnNap)(uint8_t wdto);
+
+/**
+ * @brief reset simulation: real time and millis() to `startMS`, no interrupts pending
+ */
+void simReset(uint32_t startMS = 0);
+
+/**
+ * @brief let an interrupt occur at real time `atMS`, setting `wokeUpWhy` to `why`,
+ * delivered while sleeping only; if `everyMS` !=0, repeat it forever
+ */
+void simInterrupt(uint32_t atMS, uint8_t why, uint32_t everyMS = 0);
+
+/**
+ * @brief forget all interrupts not delivered yet
+ */
+void simClearInterrupts();
+
+#endif // __SIM_H
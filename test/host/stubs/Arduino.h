@@ -0,0 +1,31 @@
+// Host stand-in for the Arduino core, just enough to build MySnooze.cpp, see sim.cpp
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define F(s)				(s)
+#define pgm_read_word(p)	(*(const uint16_t*)(p))
+#define pgm_read_dword(p)	(*(const uint32_t*)(p))
+#define EMPTY_INTERRUPT(v)	static_assert(true, #v)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/// prints to stdout
+class Print {
+public:
+	void print(const char* s);
+	void print(char c);
+	void print(unsigned char n);
+	void print(int n);
+	void print(unsigned int n);
+	void print(long n);
+	void print(unsigned long n);
+	template <typename T> void println(T x) { print(x); println(); }
+	void println();
+};
@@ -0,0 +1,37 @@
+// Host stand-in for <avr/io.h>: registers used by MySnooze, simulated in sim.cpp
+#pragma once
+#include <stdint.h>
+
+#define _BV(b)		(1u << (b))
+
+// ADC
+#define ADEN	7
+#define ADSC	6
+#define ADPS2	2
+#define ADPS1	1
+#define ADPS0	0
+#define REFS0	6
+#define MUX3	3
+#define MUX2	2
+#define MUX1	1
+
+/// ADC control register, setting ADSC runs a conversion of the simulated supply voltage
+struct simADCSRA_t {
+	uint8_t v;
+	operator uint8_t() const { return v; }
+	simADCSRA_t& operator=(uint8_t x);
+	simADCSRA_t& operator|=(int x) { return *this = v | x; }
+	simADCSRA_t& operator&=(int x) { return *this = v & x; }
+};
+extern simADCSRA_t ADCSRA;
+extern volatile uint8_t ADMUX;
+extern volatile uint16_t ADC;
+
+// watchdog
+#define WDIE	6
+#define WDCE	4
+#define WDE		3
+extern volatile uint8_t WDTCSR;
+
+void cli();
+void sei();
@@ -0,0 +1,10 @@
+// Host stand-in for <avr/sleep.h>, sleep_cpu() runs one simulated nap
+#pragma once
+#include <avr/io.h>
+
+#define SLEEP_MODE_PWR_DOWN		2
+#define set_sleep_mode(m)		((void)(m))
+#define sleep_enable()
+#define sleep_disable()
+
+void sleep_cpu();
@@ -0,0 +1,6 @@
+// Host stand-in for <util/atomic.h>
+#pragma once
+#include <avr/io.h>
+
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type)	for (uint8_t _done = (cli(), 0); !_done; _done = 1, sei())
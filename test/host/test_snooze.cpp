@@ -0,0 +1,476 @@
+/**
+ * @file       test_snooze.cpp
+ *
+ * Property tests of snooze() and snoozeStep() on the host, against simulated naps.
+ * Durations are drawn from the whole uint32_t range with a fixed seed, so runs are
+ * repeatable. Checks time credited to millis(), number of naps, and tick() cadence.
+ */
+
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include "MySnooze.h"
+#include "sim.h"
+
+static int failures;
+
+#define CHECK(cond, fmt, ...) do { \
+	if (!(cond)) { \
+		if (++failures <= 20) printf("%s:%d: %s, " fmt "\n", __FILE__, __LINE__, #cond, ##__VA_ARGS__); \
+	} } while (0)
+
+static std::mt19937 rng(20261018);
+
+/// duration with log-uniform distribution over the whole uint32_t range
+static uint32_t randomMS()
+{
+	const uint32_t bits = rng() % 33;
+	return bits ? rng() >> (32 - bits) : 0;
+}
+
+//----- tick() and helpers
+
+static std::vector<uint32_t> tickAt;	// millis() at every tick() call
+static int8_t tickResult;
+static uint8_t tickNap = SIM_FOREVER;	// nap taken by tick(), e.g. to let a signal settle
+
+int8_t tick()
+{
+	CHECK(simIntEnabled, "tick() with interrupts disabled");
+	tickAt.push_back(millis());
+	if (tickNap != SIM_FOREVER) snoozeNap(tickNap);
+	return tickResult;
+}
+
+
+static void reset(uint32_t startMS = 0)
+{
+	simReset(startMS);
+	tickAt.clear();
+	tickResult = 0;
+	tickNap = SIM_FOREVER;
+	snoozeSetWakeFilter(NULL);
+#if !defined(MY_SNOOZE_MINIMAL)
+	snoozeSetCoalesceWindow(0);
+	snoozeSetVccThreshold(0, 0);
+#endif
+}
+
+
+/**
+ * @brief tick() is called after every 8s of sleep, or a little less if no nap fits,
+ * and once when sleep is over
+ * @param exact  false if naps may be half-credited, then ticks may come earlier
+ */
+static void checkTickCadence(uint32_t startMS, uint32_t ms, bool exact = true)
+{
+	CHECK(!tickAt.empty() && tickAt.back() == (uint32_t)millis(), "ms=%u: no tick at end of sleep", ms);
+	uint32_t prev = startMS;
+	for (size_t i=0; i+1<tickAt.size(); i++) {
+		const uint32_t dt = tickAt[i] - prev;
+		CHECK((!exact || dt > 8000 - 15) && dt <= 8000, "ms=%u: tick %zu after %u ms", ms, i, dt);
+		prev = tickAt[i];
+	}
+	if (!tickAt.empty())
+		CHECK(tickAt.back() - prev <= 8000, "ms=%u: last tick %u ms late", ms, tickAt.back() - prev);
+}
+
+//----- properties
+
+static const uint16_t napMS[] = { 15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000 };
+
+
+/**
+ * @brief credited time is never more than requested, and misses less than the shortest nap
+ */
+static void testCreditedTime()
+{
+	std::vector<uint32_t> cases = { 1, 14, 15, 16, 29, 30, 7999, 8000, 8001, 16000, UINT32_MAX };
+	for (int i=0; i<300; i++) cases.push_back(randomMS());
+
+	for (uint32_t ms : cases) {
+		if (!ms) continue;
+		const uint32_t start = rng();		// also across millis() overflow
+		reset(start);
+		const int8_t why = snooze(ms);
+		const uint32_t credited = millis() - start;
+		CHECK(why == MY_WAKE_UP_BY_TIMER, "ms=%u: why=%d", ms, why);
+		CHECK(credited <= ms && ms - credited < 15, "ms=%u: credited %u", ms, credited);
+		CHECK(simNowMS - start == credited, "ms=%u: millis() off real time by %d", ms, (int)(simNowMS - start - credited));
+		CHECK(simIntEnabled, "ms=%u: interrupts disabled after sleep", ms);
+		checkTickCadence(start, ms);
+	}
+}
+
+
+/**
+ * @brief for every duration up to 40s, naps are as few as possible while missing less 
+ * than the shortest nap, e.g. 250ms for 255ms, not 120+120+15
+ */
+static void testNapCount()
+{
+	const uint32_t N = 40000;
+	std::vector<uint32_t> best(N+1, UINT32_MAX);	// min naps summing to exactly n ms
+	best[0] = 0;
+	for (uint32_t n=1; n<=N; n++)
+		for (uint16_t nap : napMS)
+			if (nap <= n && best[n-nap] != UINT32_MAX && best[n-nap] + 1 < best[n])
+				best[n] = best[n-nap] + 1;
+
+	for (uint32_t ms=1; ms<=N; ms++) {
+		uint32_t fewest = UINT32_MAX;
+		for (uint32_t s = (ms < 15) ? 0 : ms-14; s<=ms; s++)
+			if (best[s] < fewest) fewest = best[s];
+		reset();
+		snooze(ms);
+		CHECK(ms - millis() < 15, "ms=%u: credited %lu", ms, millis());
+		CHECK(simNaps == fewest, "ms=%u: %u naps, %u would do", ms, simNaps, fewest);
+	}
+}
+
+
+/**
+ * @brief sleep in steps of random size credits the same time as one snooze(),
+ * keeps tick() cadence across steps, and every step naps at least once
+ */
+static void testSteps()
+{
+	for (int i=0; i<300; i++) {
+		const uint32_t ms = (i == 0) ? 10000 : 15 + randomMS() % 100000;
+		const uint32_t maxStep = (i == 0) ? 100 : rng() % 400;
+		reset();
+		CHECK(snoozeBegin(ms) == SNOOZE_PENDING, "ms=%u: begin failed", ms);
+		int8_t why;
+		uint32_t steps = 0;
+		do {
+			const uint32_t before = millis();
+			const uint32_t maxMS = maxStep ? 1 + rng() % maxStep : 0;
+			why = snoozeStep(maxMS);
+			const uint32_t slept = millis() - before;
+			CHECK(simIntEnabled, "ms=%u: interrupts disabled after step", ms);
+			if (why == SNOOZE_PENDING) {
+				CHECK(slept >= 15, "ms=%u: step %u slept only %u ms", ms, steps, slept);
+				CHECK(slept <= (maxMS < 15 ? 15 : maxMS), "ms=%u: step %u slept %u ms > %u", ms, steps, slept, maxMS);
+			}
+			steps++;
+		} while (why == SNOOZE_PENDING && steps < 100000);
+		const uint32_t credited = millis();
+		CHECK(why == MY_WAKE_UP_BY_TIMER, "ms=%u: why=%d", ms, why);
+		CHECK(credited <= ms && ms - credited < 15, "ms=%u max=%u: credited %u", ms, maxStep, credited);
+		checkTickCadence(0, ms);
+		CHECK(snoozeStep(100) == MY_SLEEP_NOT_POSSIBLE, "ms=%u: step after end", ms);
+	}
+}
+
+
+/**
+ * @brief spurious wakeups don't end sleep, and don't make it longer than requested
+ */
+static int8_t rejectAll(int8_t) { return 0; }
+
+static int8_t debounceAndReject(int8_t)
+{
+	snoozeNap(WDTO_30MS);
+	return 0;
+}
+
+static void testRejectedWakeups()
+{
+	// naps taken by tick() count as sleep time too, only the one in the last tick() adds to it
+	reset();
+	tickNap = WDTO_2S;
+	snooze(60000);
+	CHECK(millis() - 2000 <= 60000 && millis() - 2000 > 60000 - 15, "nap in tick(): credited %lu", millis());
+	tickNap = SIM_FOREVER;
+
+	const wakeFilter_t filters[] = { rejectAll, debounceAndReject };
+	for (wakeFilter_t filter : filters) {
+		for (uint32_t every : { 0u, 7u, 100u, 3000u }) {
+			reset();
+			snoozeSetWakeFilter(filter);
+			simInterrupt(4321, 1, every);
+			const int8_t why = snooze(60000);
+			CHECK(why == MY_WAKE_UP_BY_TIMER, "every=%u: why=%d", every, why);
+			CHECK(millis() <= 60000 && millis() > 60000 - 15, "every=%u: credited %lu", every, millis());
+			checkTickCadence(0, 60000, false);
+		}
+	}
+}
+
+
+/**
+ * @brief interrupt ends sleep
+ */
+static void testInterrupts()
+{
+	reset();
+	simInterrupt(5000, 3);
+	CHECK(snooze(60000) == 3, "plain interrupt");
+	CHECK(simIntEnabled, "interrupts disabled after sleep");
+
+	reset();
+	simInterrupt(5000, 3);
+	CHECK(snooze(0) == 3, "interrupt ends sleep forever");
+
+	// interrupt while the main loop works between steps ends sleep in the next step
+	for (uint32_t ms : { 60000u, 0u }) {
+		reset();
+		snoozeBegin(ms);
+		CHECK(snoozeStep(100) == SNOOZE_PENDING, "ms=%u: first step", ms);
+		const uint32_t before = millis();
+		wokeUpWhy = 3;
+		const int8_t why = snoozeStep(100);
+		CHECK(why == 3 && millis() == before, "ms=%u: wake between steps, why=%d after %lu ms", ms, why, millis() - before);
+		CHECK(wokeUpWhy == 0, "ms=%u: wokeUpWhy not cleared", ms);
+	}
+
+	// ... but not an interrupt from before sleep
+	reset();
+	wokeUpWhy = 3;
+	CHECK(snooze(1000) == MY_WAKE_UP_BY_TIMER, "old interrupt ended sleep");
+}
+
+#if !defined(MY_SNOOZE_MINIMAL)
+
+/**
+ * @brief coalescing window merges interrupts
+ */
+static int8_t keyFilter(int8_t why) { return why == 0x10 ? 0x55 : why; }
+
+static snoozeTask_t windowTask;
+static uint32_t windowTaskMS;		// millis() when task ran last
+
+static int8_t windowTaskFunc(snoozeTask_t* t)
+{
+	TASK_BEGIN(t);
+	for (;;) {
+		windowTaskMS = millis();
+		TASK_SLEEP(t, 50);
+	}
+	TASK_END(t);
+}
+
+static void testCoalescing()
+{
+	reset();
+	simInterrupt(5000, 3);
+	CHECK(snooze(60000) == 3 && snoozeBurstCount() == 0, "no burst without window");
+
+	// OR-ed values of a burst
+	reset();
+	snoozeSetCoalesceWindow(500);
+	simInterrupt(5000, 0x01);
+	simInterrupt(5100, 0x02);
+	simInterrupt(5200, 0x04);
+	CHECK(snooze(60000) == 0x07, "burst");
+	CHECK(snoozeBurstCount() == 3, "burst count %u", snoozeBurstCount());
+
+	// endless burst still ends after the window
+	reset();
+	snoozeSetCoalesceWindow(500);
+	simInterrupt(5000, 0x01, 7);
+	CHECK(snooze(0) == 0x01, "endless burst");
+
+	// values with sign bit are not merged, result is never MY_WAKE_UP_BY_TIMER
+	reset();
+	snoozeSetCoalesceWindow(500);
+	simInterrupt(5000, 0x40);
+	simInterrupt(5100, 0xBF);
+	int8_t why = snooze(60000);
+	CHECK(why == (int8_t)0xBF, "sign bit: why=%d", why);
+
+	// codes translated by the filter are not merged
+	reset();
+	snoozeSetCoalesceWindow(500);
+	snoozeSetWakeFilter(keyFilter);
+	simInterrupt(5000, 0x01);
+	simInterrupt(5100, 0x10);
+	why = snooze(60000);
+	CHECK(why == 0x55, "translated: why=%d", why);
+	reset();
+	snoozeSetCoalesceWindow(500);
+	snoozeSetWakeFilter(keyFilter);
+	simInterrupt(5000, 0x10);
+	simInterrupt(5100, 0x01);
+	why = snooze(60000);
+	CHECK(why == 0x55 && snoozeBurstCount() == 0, "translated first: why=%d", why);
+
+	// tasks keep running during the window
+	reset();
+	snoozeSetCoalesceWindow(500);
+	snoozeStartTask(&windowTask, windowTaskFunc);
+	simInterrupt(5000, 0x01);
+	snooze(60000);
+	CHECK(simNowMS >= 5000 + 500 - 15 && millis() - windowTaskMS <= 50, "task last ran at %u, window ended at %lu", windowTaskMS, millis());
+	windowTask.lc = TASK_DONE;		// end task at next run
+	snooze(100);
+	CHECK(!snoozeTaskRunning(&windowTask), "task still running");
+}
+
+
+/**
+ * @brief tasks run with interrupts and ADC enabled, and ending sleep before the first 
+ * nap leaves interrupts enabled
+ */
+static snoozeTask_t wakeTask;
+static bool wakeTaskIntEnabled;
+static bool wakeTaskADC;
+
+static int8_t wakeTaskFunc(snoozeTask_t* t)
+{
+	TASK_BEGIN(t);
+	wakeTaskIntEnabled = simIntEnabled;
+	wakeTaskADC = ADCSRA & _BV(ADEN);
+	TASK_WAKE(t, 42);
+	TASK_END(t);
+}
+
+static void testTasks()
+{
+	reset();
+	ADCSRA = _BV(ADEN);
+	snoozeStartTask(&wakeTask, wakeTaskFunc);
+	CHECK(snooze(10000) == 42, "task wakeup");
+	CHECK(simNaps == 0, "napped before task");
+	CHECK(wakeTaskIntEnabled, "task ran with interrupts disabled");
+	CHECK(wakeTaskADC, "task ran with ADC disabled");
+	CHECK(ADCSRA & _BV(ADEN), "ADC disabled after sleep");
+	CHECK(simIntEnabled, "interrupts disabled after task wakeup");
+	ADCSRA = 0;
+	snooze(100);
+	CHECK(!snoozeTaskRunning(&wakeTask), "task still running");
+
+	// short sleep without nap
+	reset();
+	snooze(10);
+	CHECK(simNaps == 0 && simIntEnabled, "short sleep");
+}
+
+
+/**
+ * @brief supply voltage is checked once when the whole sleep ends, not after every step,
+ * and time listeners are called once per sleep, with the time of all steps and rechecks
+ */
+// snoozeReadVcc() does 2 conversions, raise voltage after 2 checks
+static void raiseVcc(uint8_t) { if (simVccReads >= 4) simVccMV = 3300; }
+
+static uint32_t listenerCalls, listenerMS;
+static void listener(uint32_t ms) { listenerCalls++; listenerMS += ms; }
+
+static void testVccGate()
+{
+	reset();
+	snoozeAddTimeListener(listener);
+	listenerCalls = listenerMS = 0;
+	snoozeSetVccThreshold(3000, 2800);
+	simVccMV = 2500;
+	simOnNap = raiseVcc;
+	CHECK(snooze(1000) == MY_WAKE_UP_BY_TIMER, "snooze with low Vcc");
+	CHECK(simVccReads == 6 && millis() == 1000 + 2 * MY_SNOOZE_VCC_RECHECK_MS, "snooze: %u reads, millis=%lu", simVccReads, millis());
+	CHECK(listenerCalls == 1 && listenerMS == millis(), "snooze: %u listener calls, %u ms", listenerCalls, listenerMS);
+	listenerCalls = listenerMS = 0;
+
+	simReset();
+	simVccMV = 2500;
+	simOnNap = raiseVcc;
+	snoozeBegin(10000);
+	int steps = 0;
+	while (snoozeStep(300) == SNOOZE_PENDING) {
+		CHECK(simVccReads == 0, "Vcc read during step %d", steps);
+		steps++;
+	}
+	CHECK(simVccReads == 6, "steps: %u reads", simVccReads);
+	CHECK(millis() > 10000 - 15 + 2 * MY_SNOOZE_VCC_RECHECK_MS, "steps: millis=%lu", millis());
+	CHECK(listenerCalls == 1 && listenerMS == millis(), "steps: %u listener calls, %u ms", listenerCalls, listenerMS);
+	snoozeRemoveTimeListener(listener);
+}
+
+
+/**
+ * @brief conversions wait at least the conversion time, also with a burst of interrupts
+ */
+static uint32_t convStartMS, convReadMS;
+static void convStart() { convStartMS = simNowMS; }
+static void convRead() { convReadMS = simNowMS; }
+static snoozeConversion_t conv = { convStart, convRead, 750, NULL };
+
+static void testConversions()
+{
+	snoozeAddConversion(&conv);
+	for (uint32_t every : { 0u, 1u, 10u }) {
+		reset();
+		snoozeSetVccThreshold(3000, 2800);
+		simVccMV = 2500;
+		if (every) simInterrupt(100, 5, every);
+		const int8_t why = snoozeConvertAll();
+		CHECK(why == (every ? 5 : MY_WAKE_UP_BY_TIMER), "every=%u: why=%d", every, why);
+		CHECK(convReadMS - convStartMS >= 750, "every=%u: read after %u ms", every, convReadMS - convStartMS);
+		CHECK(simVccReads == 0, "every=%u: Vcc read in conversion", every);
+	}
+}
+
+#endif // MY_SNOOZE_MINIMAL
+
+
+/**
+ * @brief trace keeps the last MY_SNOOZE_TRACE calls, oldest first, also beyond 255 entries,
+ * and the nap an interrupt ended sleep in
+ */
+static void testTrace()
+{
+#if defined(MY_SNOOZE_TRACE)
+	reset();
+	snoozeTraceClear();
+	const uint32_t N = MY_SNOOZE_TRACE + 50;
+	for (uint32_t n=1; n<=N; n++) {
+		delay(n);
+		snooze(15 * n);
+	}
+	CHECK(snoozeTraceCount() == MY_SNOOZE_TRACE, "%u entries", snoozeTraceCount());
+	for (uint16_t i=0; i<MY_SNOOZE_TRACE; i++) {
+		const snoozeTraceEntry_t* e = snoozeTraceGet(i);
+		const uint32_t n = N - MY_SNOOZE_TRACE + 1 + i;
+		CHECK(e && e->requestedMS == 15 * n && e->awakeMS == n && 15 * n - e->sleptMS < 15 
+			&& e->why == MY_WAKE_UP_BY_TIMER, "entry %u", i);
+	}
+	CHECK(snoozeTraceGet(MY_SNOOZE_TRACE) == NULL, "entry past end");
+
+	// interrupted nap is recorded, it is not in sleptMS
+	reset();
+	snoozeTraceClear();
+	simInterrupt(5000, 3);
+	snooze(60000);
+	const snoozeTraceEntry_t* e = snoozeTraceGet(0);
+	CHECK(e && e->why == 3 && e->sleptMS == 0 && e->napMS == 8000, "interrupted nap");
+	snooze(1000);
+	e = snoozeTraceGet(1);
+	CHECK(e && e->why == MY_WAKE_UP_BY_TIMER && e->napMS == 0, "nap after timer");
+#endif
+}
+
+
+int main()
+{
+	testCreditedTime();
+	testNapCount();
+	testSteps();
+	testRejectedWakeups();
+	testInterrupts();
+#if !defined(MY_SNOOZE_MINIMAL)
+	testCoalescing();
+	testTasks();
+	testVccGate();
+	testConversions();
+#endif
+	testTrace();
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}